@@ -22,6 +22,10 @@
 
 #include "lqAobj.h"
 #include <QGraphicsScene>
+#include <QPen>
+#include <QLineF>
+#include <qmath.h>
+#include <qnumeric.h>
 
 lqItem::lqItem(QGraphicsScene *s, items l)
 {
@@ -38,3 +42,134 @@ QVariant lqItem::itemChange(GraphicsItemChange change, const QVariant &value)
     emit itemHasChanged(change, value);
     return value;
 }
+
+//! level of detail: toggle QGraphicsTextItem children
+void lqItem::show_labels(bool on)
+{
+    foreach(auto c, childItems())
+        if (qgraphicsitem_cast<QGraphicsTextItem*>(c))
+            c->setVisible(on);
+}
+
+//! build on first request a polyline thru bezier end points
+void lqEdge::simplify(bool on)
+{
+    if (on && !simplified) {
+        QPainterPath p;
+        QPen pen;
+        foreach(auto c, childItems())
+            if (auto i = c != highlighted ? qgraphicsitem_cast<QGraphicsPathItem*>(c) : 0) {
+                const QPainterPath &s = i->path();
+                int data = 0;
+                for (int e = 0; e < s.elementCount(); ++e) {
+                    const QPainterPath::Element &x = s.elementAt(e);
+                    switch (x.type) {
+                    case QPainterPath::MoveToElement:
+                        p.moveTo(x);
+                        break;
+                    case QPainterPath::LineToElement:
+                        p.lineTo(x);
+                        break;
+                    case QPainterPath::CurveToElement:
+                        data = 0;
+                        break;
+                    case QPainterPath::CurveToDataElement:
+                        if (++data == 2)
+                            p.lineTo(x);
+                        break;
+                    }
+                }
+                pen = i->pen();
+            }
+        pen.setWidth(0);
+        simplified = new QGraphicsPathItem(p, this);
+        simplified->setPen(pen);
+    }
+
+    foreach(auto c, childItems())
+        if (c != simplified && c != highlighted && !qgraphicsitem_cast<QGraphicsTextItem*>(c))
+            c->setVisible(!on);
+    if (simplified)
+        simplified->setVisible(on);
+}
+
+//! build on first request a box covering the cluster, colored as the frame
+void lqGraph::boxed(bool on)
+{
+    if (on && !box) {
+        QBrush brush;
+        foreach(auto c, childItems())
+            if (auto i = dynamic_cast<QAbstractGraphicsShapeItem*>(c)) {
+                if (i->brush().style() != Qt::NoBrush)
+                    brush = i->brush();
+                else {
+                    QColor f = i->pen().color();
+                    f.setAlpha(64);
+                    brush = QBrush(f);
+                }
+                break;
+            }
+        box = new QGraphicsRectItem(childrenBoundingRect(), this);
+        box->setBrush(brush);
+        box->setPen(Qt::NoPen);
+    }
+
+    foreach(auto c, childItems())
+        if (c != box && !qgraphicsitem_cast<QGraphicsTextItem*>(c))
+            c->setVisible(!on);
+    if (box)
+        box->setVisible(on);
+}
+
+//! flatten once: picking and highlighting avoid bezier stroking
+const QList<QPolygonF>& lqEdge::route() const
+{
+    if (route_.isEmpty()) {
+        foreach(auto c, childItems())
+            if (c != simplified && c != highlighted) {
+                if (auto i = qgraphicsitem_cast<QGraphicsPathItem*>(c))
+                    foreach(auto p, i->path().toSubpathPolygons())
+                        route_ << i->mapToParent(p);
+                else if (auto i = qgraphicsitem_cast<QGraphicsPolygonItem*>(c)) {
+                    QPolygonF p = i->polygon();
+                    if (!p.isEmpty())
+                        p << p.first();
+                    route_ << i->mapToParent(p);
+                }
+            }
+        foreach(auto p, route_)
+            route_rect_ |= p.boundingRect();
+    }
+    return route_;
+}
+
+//! distance from segments
+qreal lqEdge::distance(QPointF p) const
+{
+    QPointF l = mapFromScene(p);
+    qreal d = qInf();
+    foreach(auto r, route())
+        for (int i = 1; i < r.size(); ++i) {
+            QPointF a = r[i - 1], v = r[i] - a, w = l - a;
+            qreal n = QPointF::dotProduct(v, v);
+            qreal t = n > 0 ? qBound(0., QPointF::dotProduct(w, v) / n, 1.) : 0;
+            d = qMin(d, QLineF(l, a + t * v).length());
+        }
+    return d;
+}
+
+//! build on first request a wide path along route
+void lqEdge::highlight(bool on)
+{
+    if (on && !highlighted) {
+        QPainterPath p;
+        foreach(auto r, route())
+            p.addPolygon(r);
+        QPen pen(QColor(255, 128, 0, 160), 4);
+        pen.setCosmetic(true);
+        highlighted = new QGraphicsPathItem(p, this);
+        highlighted->setPen(pen);
+    }
+    if (highlighted)
+        highlighted->setVisible(on);
+}
@@ -53,6 +53,9 @@ public:
     QString name() const { return name_; }
     void setName(QString name) { name_ = name; }
 
+    //! level of detail: show/hide text labels
+    void show_labels(bool on);
+
 protected:
 
     //! serve itemHasChanged() signal
@@ -98,12 +101,33 @@ class lqEdge : public lqItem {
 public:
 
     //! construct with graphics primitives
-    lqEdge(QGraphicsScene *s, items l) : lqItem(s, l) {}
+    lqEdge(QGraphicsScene *s, items l) : lqItem(s, l), simplified(0), highlighted(0) {}
 
     //! fullfill qgraphics_cast requirements
     enum { Type = UserType + 2 };
     int type() const { return Type; }
 
+    //! level of detail: replace curves and arrowheads with a polyline
+    void simplify(bool on);
+
+    //! curves and arrowheads flattened, in item coordinates - computed on first request
+    const QList<QPolygonF>& route() const;
+
+    //! bounding rect of route, in item coordinates
+    QRectF route_rect() const { route(); return route_rect_; }
+
+    //! distance of route from <p>, in scene coordinates
+    qreal distance(QPointF p) const;
+
+    //! draw route on top, wider
+    void highlight(bool on);
+
+private:
+    QGraphicsPathItem *simplified;
+    QGraphicsPathItem *highlighted;
+    mutable QList<QPolygonF> route_;
+    mutable QRectF route_rect_;
+
 signals:
 
 public slots:
@@ -118,12 +142,18 @@ class lqGraph : public lqItem {
 public:
 
     //! construct with graphics primitives
-    lqGraph(QGraphicsScene *s, items l) : lqItem(s, l) {}
+    lqGraph(QGraphicsScene *s, items l) : lqItem(s, l), box(0) {}
 
     //! fullfill qgraphics_cast requirements
     enum { Type = UserType + 3 };
     int type() const { return Type; }
 
+    //! level of detail: draw as a filled box
+    void boxed(bool on);
+
+private:
+    QGraphicsRectItem *box;
+
 signals:
 
 public slots:
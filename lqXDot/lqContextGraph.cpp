@@ -23,9 +23,16 @@
 #include "lqContextGraph.h"
 #include "lqXDotScene.h"
 #include "lqXDot_configure.h"
+#include "lqLayoutJob.h"
 
+#include <QSet>
 #include <QStack>
 #include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QThreadStorage>
 
 /** shortcuts */
 inline void OK(int rc) { Q_ASSERT(rc == 0); Q_UNUSED(rc); }
@@ -36,8 +43,11 @@ lqContextGraph::lqContextGraph(QObject *parent) :
     QObject(parent),
     trace_control(0),
     context(0),
-    graph(0)
+    graph(0),
+    job(0),
+    clusters_indexed(false)
 {
+    resolve_symbols();
 }
 
 /** keep pointers allocated elsewhere (Prolog, in first use case)
@@ -46,14 +56,22 @@ lqContextGraph::lqContextGraph(GVC_t* context, Agraph_t *graph, QObject *parent)
     QObject(parent),
     trace_control(0),
     context(context),
-    graph(graph)
+    graph(graph),
+    job(0),
+    clusters_indexed(false)
 {
+    resolve_symbols();
 }
 
 /** release resources
  */
 lqContextGraph::~lqContextGraph()
 {
+    // jobs use context: complete them before releasing
+    foreach(auto j, findChildren<lqLayoutJob*>()) {
+        j->cancel();
+        j->wait();
+    }
     clear();
 }
 
@@ -61,33 +79,55 @@ lqContextGraph::~lqContextGraph()
  */
 void lqContextGraph::clear() {
     if (context) {
+        QMutexLocker lk(context_lock(context));
         if (graph) {
+            lqXDotScene::clear_XDotCache(this);
             gvFreeLayout(context, graph);
             agclose(graph);
             graph = 0;
+            resolve_symbols();
         }
 
         // no layout performed on buffers
         foreach(auto p, buffers)
             agclose(p.spare_graph);
         buffers.clear();
+        structure_changed();
 
         gvFreeContext(context);
         context = 0;
     }
 }
 
-/** keep a static list to collect errors from global handler
+/** keep a list for each thread to collect errors from global handler
  */
-QStringList lqContextGraph::errors;
+static QThreadStorage<QStringList> thread_errors;
 const int max_errors = 10;
 
+QStringList& lqContextGraph::errors() {
+    return thread_errors.localData();
+}
+
 int lqContextGraph::store_errors(char *msg) {
-    if (errors.count() < max_errors)
-        errors.append(QString::fromUtf8(msg));
+    qDebug() << "Graphviz:" << msg;
+    QStringList &e = errors();
+    if (e.count() < max_errors)
+        e.append(QString::fromUtf8(msg));
     return 0;
 }
 
+/** the handler is global, and jobs run concurrently: install once, never restore
+ */
+void lqContextGraph::catch_errors() {
+    static QMutex m;
+    static bool installed = false;
+    QMutexLocker lk(&m);
+    if (!installed) {
+        agseterrf(store_errors);
+        installed = true;
+    }
+}
+
 /** perform task
  *  display a box with errors (upto max_errors), if any
  *  return true if no error happened
@@ -96,16 +136,15 @@ bool lqContextGraph::run_with_error_report(std::function<QString()> worker) {
 
     QString err;
     try {
-        errors.clear();
-        agusererrf savef = agseterrf(store_errors);
+        catch_errors();
+        errors().clear();
         err = worker();
-        agseterrf(savef);
     }
     catch(...) {
         err = tr("Exception!");
     }
-    if (!err.isEmpty() || !errors.isEmpty()) {
-        critical(err + "\n" + errors.join("\n"));
+    if (!err.isEmpty() || !errors().isEmpty()) {
+        critical(err + "\n" + errors().join("\n"));
         return false;
     }
     return true;
@@ -132,14 +171,18 @@ bool lqContextGraph::in_context() {
 /** perform required layout with basic error handling
  */
 bool lqContextGraph::layout(QString algo) {
-    if (!in_context())
+    if (!in_context() || layout_running())
         return false;
 
     // workaround multiple boxes on root, suggested by Erg
-    agset(graph, ccstr("_draw_"), ccstr(""));
+    if (Sp s = symbol(AGRAPH, ka__draw_))
+        agxset(graph, s, ccstr(""));
 
+    QMutexLocker lk(context_lock(context));
+    lqXDotScene::clear_XDotCache(this);
     if (gvLayout(context, graph, algo.toUtf8().data()) == 0) {
         last_layout = algo;
+        resolve_symbols();
         return true;
     }
     critical(tr("gvLayout(%1) failed").arg(algo));
@@ -149,10 +192,13 @@ bool lqContextGraph::layout(QString algo) {
 /** perform rendering with basic error handling
  */
 bool lqContextGraph::render(QString algo) {
-    if (!in_context())
+    if (!in_context() || layout_running())
         return false;
+    QMutexLocker lk(context_lock(context));
+    lqXDotScene::clear_XDotCache(this);
     if (gvRender(context, graph, algo.toUtf8().data(), 0) == 0) {
         last_render = algo;
+        resolve_symbols();
         return true;
     }
     critical(tr("gvRender(%1) failed on %2").arg(algo, last_layout));
@@ -174,6 +220,9 @@ bool lqContextGraph::repeatOperations() {
 /** release layout memory with basic error handling
  */
 bool lqContextGraph::freeLayout() {
+    // objects and attribute strings are going to be recycled
+    // graph local cleanup: no need to wait for a background job on context
+    lqXDotScene::clear_XDotCache(this);
     if (gvFreeLayout(context, graph)) {
         critical(tr("gvFreeLayout failed"));
         return false;
@@ -184,14 +233,99 @@ bool lqContextGraph::freeLayout() {
 /** read from file
  */
 bool lqContextGraph::parse(FILE *fp) {
-    return (graph = agread(fp, 0)) ? true : false;
+    QMutexLocker lk(context_lock(context));
+    graph = agread(fp, 0);
+    resolve_symbols();
+    structure_changed();
+    return graph ? true : false;
 }
 
 /** read from string
  */
 bool lqContextGraph::parse(QString script) {
     clear();
-    return in_context() && (graph = agmemread(script.toUtf8())) ? true : false;
+    bool ok = false;
+    if (in_context()) {
+        // cgraph parser isn't reentrant, a job could be parsing
+        QMutexLocker lk(context_lock(context));
+        ok = (graph = agmemread(script.toUtf8())) ? true : false;
+    }
+    resolve_symbols();
+    structure_changed();
+    return ok;
+}
+
+/** a mutex for each context ever used
+ */
+QMutex* lqContextGraph::context_lock(Cp c) {
+    static QMutex locks_lock;
+    static QHash<Cp, QMutex*> locks;
+    QMutexLocker lk(&locks_lock);
+    QMutex *&l = locks[c];
+    if (!l)
+        l = new QMutex;
+    return l;
+}
+
+/** queue a layout job, the context is ready before the worker starts
+ */
+bool lqContextGraph::start_layout(QString source, bool is_file, QString algo, QString render) {
+    if (!in_context())
+        return false;
+
+    cancel_layout();
+
+    job = new lqLayoutJob(context, source, is_file, algo, render, this);
+    connect(job, SIGNAL(progress(QString)), SIGNAL(layout_progress(QString)));
+    connect(job, SIGNAL(finished()), SLOT(layout_done()));
+    job->start();
+
+    return true;
+}
+
+/** leave the job running, but forget it: result will be discarded
+ */
+void lqContextGraph::cancel_layout() {
+    if (job) {
+        job->cancel();
+        job = 0;
+    }
+}
+
+/** take ownership of the laid out graph, if the job is still current
+ */
+void lqContextGraph::layout_done() {
+    lqLayoutJob *j = qobject_cast<lqLayoutJob*>(sender());
+    if (!j)
+        return;
+
+    j->deleteLater();
+    if (j != job)
+        return;
+    job = 0;
+
+    bool ok = false;
+    if (Gp g = j->take_result()) {
+        QMutexLocker lk(context_lock(context));
+        lqXDotScene::clear_XDotCache(this);
+
+        if (graph) {
+            gvFreeLayout(context, graph);
+            agclose(graph);
+        }
+        foreach(auto p, buffers)
+            agclose(p.spare_graph);
+        buffers.clear();
+
+        graph = g;
+        last_layout = j->algo();
+        last_render = j->render();
+        resolve_symbols();
+        structure_changed();
+        ok = true;
+    }
+
+    emit layout_finished(ok, j->error());
 }
 
 /** allocate a spare graph, to store elements
@@ -236,7 +370,7 @@ void lqContextGraph::depth_first(Np root, Nf nv, Gp g) {
  */
 void lqContextGraph::depth_first(Np root, Nf nv, Ef ev, Gp g) {
     QStack<Np> s; s.push(root);
-    nodes visited;
+    QSet<Np> visited;
     while (!s.isEmpty()) {
         Np n = s.pop();
         if (!visited.contains(n)) {
@@ -278,7 +412,7 @@ GV_ptr_types::Gp lqContextGraph::fold(Np n) {
     buffer* B = buff(n, true);
 
     Nf N = [&](Np v) {
-        if (Gp s = find_inner_subgraph(v)) {
+        if (Gp s = inner_subgraph(v)) {
             Gp S = agsubg(B->spare_graph, agnameof(s), 1);
             copy(v, S);
         }
@@ -302,10 +436,11 @@ GV_ptr_types::Gp lqContextGraph::fold(Np n) {
                 QString cn = gvname(e);
                 QString hn = gvname(aghead(e));
                 Ep E = agedge(graph, agtail(e), n, 0, 1);
-                agsafeset(E, ccstr("style"), ccstr("dotted"), ccstr(""));
+                attr_set(E, ka_style, "dotted");
                 B->fake_edges << fake_edge {tn, hn, cn};
             }
         });
+        clusters.remove(x);
         OK(agdelnode(graph, x));
     }
     return B->spare_graph;
@@ -322,7 +457,7 @@ void lqContextGraph::unfold(Np n) {
     OK(agcopyattr(t, n));
 
     Nf N = [&](Np v) {
-        if (Gp s = find_inner_subgraph(v, B->spare_graph)) {
+        if (Gp s = inner_subgraph(v)) {
             Gp S = agsubg(graph, agnameof(s), 1);
             copy(v, S);
         }
@@ -342,18 +477,243 @@ void lqContextGraph::unfold(Np n) {
         agedge(graph, T, H, qcstr(i.n_save), 1);
     }
 
+    for_nodes([this](Np v) { clusters.remove(v); }, B->spare_graph);
     OK(agclose(B->spare_graph));
     buffers.remove(gvname(n));
 }
 
+QString lqContextGraph::cache_dir;
+qint64 lqContextGraph::cache_limit = 64 << 20;
+
+QString lqContextGraph::layout_cache_dir() {
+    return cache_dir;
+}
+void lqContextGraph::set_layout_cache_dir(QString dir) {
+    cache_dir = dir;
+}
+qint64 lqContextGraph::layout_cache_limit() {
+    return cache_limit;
+}
+void lqContextGraph::set_layout_cache_limit(qint64 bytes) {
+    cache_limit = bytes;
+}
+
+/** remove oldest saved layouts exceeding cache_limit
+ */
+void lqContextGraph::prune_layout_cache() {
+    qint64 total = 0;
+    foreach(QFileInfo i, QDir(cache_dir).entryInfoList(QStringList() << "*.lqxl", QDir::Files, QDir::Time))
+        if ((total += i.size()) > cache_limit)
+            QFile::remove(i.filePath());
+}
+
+/** graphs (preorder), then nodes with their out edges, as stored by Graphviz
+ *  <f> also receives the object kind (AGRAPH, AGNODE, AGEDGE)
+ */
+void lqContextGraph::visit_layout(std::function<void(void*, int)> f) {
+    depth_first([&](Gp g) { f(g, AGRAPH); });
+    for_nodes([&](Np n) {
+        f(n, AGNODE);
+        for_edges_out(n, [&](Ep e) { f(e, AGOUTEDGE); });
+    });
+}
+
+/** hash the canonical text of graph: declared attributes, then each object
+ *  with name and attribute values, excluding those computed by rendering
+ */
+QByteArray lqContextGraph::layout_key(QString algo) {
+    if (!graph)
+        return QByteArray();
+    resolve_symbols();
+
+    QCryptographicHash h(QCryptographicHash::Sha1);
+    auto add = [&](cstr s) { if (s) h.addData(s); h.addData("", 1); };
+
+    add(algo.toUtf8().constData());
+    h.addData(QByteArray::number(agisdirected(graph)) + QByteArray::number(agisstrict(graph)));
+
+    // empty values hash as undeclared ones: declaring with empty default doesn't change the key
+    QVector<QList<Sp>> decl(AGOUTEDGE + 1);
+    for (int k = AGRAPH; k <= AGOUTEDGE; ++k)
+        for (Sp sym = 0; (sym = agnxtattr(graph, k, sym)); ) {
+            bool rendered = false;
+            for (int a = ka__draw_; a <= ka__htdraw_; ++a)
+                rendered |= sym == syms[k][a];
+            if (!rendered) {
+                decl[k] << sym;
+                if (sym->defval && *sym->defval) {
+                    add(sym->name);
+                    add(sym->defval);
+                }
+            }
+        }
+
+    visit_layout([&](void *obj, int k) {
+        if (k == AGOUTEDGE) {
+            add(agnameof(agtail(Ep(obj))));
+            add(agnameof(aghead(Ep(obj))));
+        }
+        add(agnameof(obj));
+        foreach(auto sym, decl[k]) {
+            cstr v = agxget(obj, sym);
+            if (v && *v) {
+                add(sym->name);
+                add(v);
+            }
+        }
+    });
+
+    return h.result();
+}
+
+QString lqContextGraph::layout_file(QByteArray key) const {
+    return QDir(cache_dir).filePath(key.toHex() + ".lqxl");
+}
+
+/** rendered attributes by object kind */
+static const QVector<QVector<GV_ptr_types::known_attr>> &layout_attrs() {
+    typedef GV_ptr_types G;
+    static QVector<QVector<G::known_attr>> l {
+        { G::ka__draw_, G::ka__ldraw_, G::ka_bb },
+        { G::ka__draw_, G::ka__ldraw_, G::ka_pos, G::ka_width, G::ka_height },
+        { G::ka__draw_, G::ka__ldraw_, G::ka__hdraw_, G::ka__tdraw_, G::ka__hldraw_, G::ka__htdraw_, G::ka_pos }
+    };
+    return l;
+}
+
+enum { layout_magic = 0x6c71786c, layout_version = 1 };
+
+/** restore attributes as saved - graph must be the same as when key was computed
+ */
+bool lqContextGraph::load_layout(QByteArray key, QString algo) {
+    if (cache_dir.isEmpty() || key.isEmpty() || !in_context() || layout_running())
+        return false;
+
+    QFile f(layout_file(key));
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream s(&f);
+    quint32 magic, version, count;
+    QByteArray k;
+    s >> magic >> version >> k >> count;
+    if (magic != layout_magic || version != layout_version || k != key)
+        return false;
+
+    // read all before touching the graph: a bad file must leave it untouched
+    QList<QByteArray> values;
+    for (quint32 c = 0; c < count && s.status() == QDataStream::Ok; ++c) {
+        QByteArray v;
+        s >> v;
+        values << v;
+    }
+    if (s.status() != QDataStream::Ok)
+        return false;
+
+    int expected = 0;
+    visit_layout([&](void *, int k) { expected += layout_attrs()[k].size(); });
+    if (expected != values.size())
+        return false;
+
+    QMutexLocker lk(context_lock(context));
+    lqXDotScene::clear_XDotCache(this);
+
+    int i = 0;
+    visit_layout([&](void *obj, int k) {
+        foreach(auto a, layout_attrs()[k])
+            attr_set(obj, a, values[i++].constData());
+    });
+
+    // Graphviz must see a layout done, as gvRenderFilename requires: nop2 keeps all positions
+    if (gvFreeLayout(context, graph) || gvLayout(context, graph, "nop2"))
+        return false;
+    resolve_symbols();
+
+    last_layout = algo;
+    last_render = "xdot";
+    return true;
+}
+
+/** store rendered attributes, in visit order
+ */
+bool lqContextGraph::save_layout(QByteArray key) {
+    if (cache_dir.isEmpty() || key.isEmpty() || !graph)
+        return false;
+
+    QDir().mkpath(cache_dir);
+    QFile f(layout_file(key));
+    if (!f.open(QIODevice::WriteOnly))
+        return false;
+
+    QList<QByteArray> values;
+    visit_layout([&](void *obj, int k) {
+        foreach(auto a, layout_attrs()[k])
+            values << QByteArray(attr(obj, a));
+    });
+
+    QDataStream s(&f);
+    s << quint32(layout_magic) << quint32(layout_version) << key << quint32(values.size());
+    foreach(auto v, values)
+        s << v;
+    f.close();
+
+    prune_layout_cache();
+    return s.status() == QDataStream::Ok;
+}
+
+/** in memory relayout after dragging a node: neato -n keeps the nodes
+ *  where they are, and routes the edges lacking position (those incident to <n>)
+ */
+bool lqContextGraph::reroute_edges(Np n, QPointF pos, edges &changed) {
+    if (!in_context() || layout_running())
+        return false;
+
+    QMutexLocker lk(context_lock(context));
+
+    QByteArray p = QString("%1,%2!").arg(pos.x()).arg(pos.y()).toUtf8();
+    attr_set(n, ka_pos, p.constData());
+
+    auto reset = [&](Ep e) {
+        if (!changed.contains(e)) {
+            changed << e;
+            attr_set(e, ka_pos, "");
+        }
+    };
+    for_edges_in(n, reset);
+    for_edges_out(n, reset);
+
+    // straight lines would cross nodes: a user's value is left untouched, while an
+    // empty or undeclared one becomes "true" (empty would mean no edges to Graphviz)
+    QByteArray splines = attr(graph, ka_splines);
+    if (splines.isEmpty())
+        attr_set(graph, ka_splines, "true", "true");
+
+    bool ok = !gvFreeLayout(context, graph) && !gvLayout(context, graph, "nop2") && !gvRender(context, graph, "xdot", 0);
+    resolve_symbols();
+
+    // rendered values changed, their programs must be parsed again
+    lqXDotScene::clear_XDotCache(this, n);
+    foreach(Ep e, changed)
+        lqXDotScene::clear_XDotCache(this, e);
+
+    if (!ok) {
+        lk.unlock();
+        critical(tr("reroute_edges failed"));
+    }
+    return ok;
+}
+
 /** make a copy of node <n> with attributes
  *  switch to alternative buffer
+ *  copying into a subgraph updates the innermost subgraph index
  */
 GV_ptr_types::Np lqContextGraph::copy(Np n, Gp g) {
     Q_ASSERT(g);
     Q_ASSERT(agraphof(n) != g);
     Np t = agnode(g, agnameof(n), 1);
     OK(agcopyattr(n, t));
+    if (g != agroot(g))
+        clusters[t] = g;
     return t;
 }
 
@@ -379,19 +739,38 @@ void lqContextGraph::dump(QString m) {
     });
 }
 
-/** I have not yet found a better way,
- *  so make a slow linear search by now
+/** innermost subgraph holding node <n>, from index built on first request
+ *  <n> can belong to the main graph or to a fold buffer
  */
-GV_ptr_types::Gp lqContextGraph::find_inner_subgraph(Np s, Gp g) {
-    if (!g) g = graph;
-    Gp found = 0;
-l:  for (Gp subg = agfstsubg(g); subg; subg = agnxtsubg(subg))
-        for (Np n = agfstnode(subg); n; n = agnxtnode(subg, n))
-            if (n == s) {
-                g = found = subg;
-                goto l;
-            }
-    return found;
+GV_ptr_types::Gp lqContextGraph::inner_subgraph(Np n) {
+    if (!clusters_indexed) {
+        if (graph)
+            index_clusters(graph, 0);
+        foreach(auto p, buffers)
+            index_clusters(p.spare_graph, 0);
+        clusters_indexed = true;
+    }
+    return clusters.value(n, 0);
+}
+
+/** forget nodes membership, must be called when graph changes outside fold/unfold
+ */
+void lqContextGraph::structure_changed() {
+    clusters.clear();
+    clusters_indexed = false;
+}
+
+/** descend in subgraphs of <g>: on each level the first one holding a node wins
+ *  (<parent> is the holder of nodes visiting <g>)
+ */
+void lqContextGraph::index_clusters(Gp g, Gp parent) {
+    for_subgraphs([&](Gp subg) {
+        for_nodes([&](Np n) {
+            if (clusters.value(n, 0) == parent)
+                clusters[n] = subg;
+        }, subg);
+        index_clusters(subg, subg);
+    }, g);
 }
 
 /** attempt to remove all attrs created by XDOT rendering
@@ -399,13 +778,40 @@ l:  for (Gp subg = agfstsubg(g); subg; subg = agnxtsubg(subg))
 void lqContextGraph::clearXDotAttrs() {
     typedef lqXDotScene S;
     for_nodes([this](Np n) {
-        S::clear_XDotAttrs(n, S::x_attrs_node);
-        for_edges_out(n, [](Ep e) {
-            S::clear_XDotAttrs(e, S::x_attrs_edge);
+        S::clear_XDotAttrs(this, n, S::x_attrs_node);
+        for_edges_out(n, [this](Ep e) {
+            S::clear_XDotAttrs(this, e, S::x_attrs_edge);
         });
     });
 }
 
+cstr lqContextGraph::known_attr_name(known_attr a) {
+    static cstr names[n_known_attrs] = {
+        "_draw_", "_ldraw_", "_hdraw_", "_tdraw_", "_hldraw_", "_htdraw_",
+        "pos", "width", "height", "bb", "style", "tooltip", "truecolor", "imagepath", "splines"
+    };
+    return names[a];
+}
+
+/** attributes are declared on root graph, for each kind
+ */
+void lqContextGraph::resolve_symbols() {
+    for (int k = AGRAPH; k <= AGOUTEDGE; ++k)
+        for (int a = 0; a < n_known_attrs; ++a)
+            syms[k][a] = graph ? agattr(graph, k, ccstr(known_attr_name(known_attr(a))), 0) : 0;
+}
+
+int lqContextGraph::attr_set(void *obj, known_attr a, cstr value, cstr def) {
+    int k = kind_of(obj);
+    Gp root = agroot(obj);
+    Sp s = symbol(obj, a);
+    if (!s && !(s = agattr(root, k, ccstr(known_attr_name(a)), ccstr(def))))
+        return -1;
+    if (root == graph)
+        syms[k][a] = s;
+    return agxset(obj, s, ccstr(value));
+}
+
 /** display a messagebox, if not disabled
  */
 void GV_ptr_types::critical(QString msg) {
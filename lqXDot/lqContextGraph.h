@@ -28,8 +28,14 @@
 #include <QMessageBox>
 #include <QGraphicsItem>
 #include <QHash>
+#include <QMutex>
+#include <QVector>
+#include <QSharedPointer>
+#include <graphviz/xdot.h>
 #include <functional>
 
+class lqLayoutJob;
+
 //! utility to get an applicative meaningful pointer from nested graphic
 template<class T> inline T* ancestor(QGraphicsItem* i) {
     for ( ; i; i = i->parentItem())
@@ -52,6 +58,7 @@ inline char* qcstr(QString s) {
 }
 
 //! get Graphviz string attributes preserving CV qualifiers
+//! lookup by name: for attributes used while rendering see lqContextGraph::attr
 inline cstr attr_str(void* obj, cstr name) {
     return agget(obj, ccstr(name));
 }
@@ -87,9 +94,31 @@ struct LQXDOTSHARED_EXPORT GV_ptr_types {
     //! edges collection
     typedef Agedge_t* Ep;
 
-    //! graphviz keeps strings/symbols unique (TBD exploit in scene creation)
+    //! graphviz keeps strings/symbols unique: see known_attr
     typedef Agsym_t* Sp;
 
+    //! attributes used by rendering, resolved to symbols once per layout
+    //! first ones are XDOT ops, in lqXDotScene::x_attrs bits order
+    enum known_attr {
+        ka__draw_,
+        ka__ldraw_,
+        ka__hdraw_,
+        ka__tdraw_,
+        ka__hldraw_,
+        ka__htdraw_,
+        ka_pos,
+        ka_width,
+        ka_height,
+        ka_bb,
+        ka_style,
+        ka_tooltip,
+        ka_truecolor,
+        ka_imagepath,
+        ka_splines,
+        n_known_attrs
+    };
+    static cstr known_attr_name(known_attr a);
+
     //! utilities
     typedef QList<Ep> edges;
     typedef QList<Np> nodes;
@@ -117,7 +146,8 @@ struct LQXDOTSHARED_EXPORT GV_ptr_types {
         tf_perform_attrs,
         tf_perform_attrs_xdot_op,
         tf_show_node_type,
-        tf_redo_objects
+        tf_redo_objects,
+        tf_build_timing
     };
 
     //! display a box -- TBD log to file
@@ -171,6 +201,37 @@ public:
     //! serial input - from string
     bool parse(QString f);
 
+    //! identify graph content (structure and attributes) and <algo>, before layout
+    QByteArray layout_key(QString algo);
+
+    //! directory of persistent layouts, empty (default) disables the cache
+    static QString layout_cache_dir();
+    static void set_layout_cache_dir(QString dir);
+
+    //! bytes kept in layout cache directory, oldest layouts are removed when exceeding
+    static qint64 layout_cache_limit();
+    static void set_layout_cache_limit(qint64 bytes);
+
+    //! apply rendered attributes saved under <key>, instead of layout(algo) and render
+    bool load_layout(QByteArray key, QString algo);
+
+    //! save rendered attributes under <key>
+    bool save_layout(QByteArray key);
+
+    //! parse, layout and render on a worker thread, cancelling any pending job
+    //! current graph is kept until completion, then replaced
+    bool start_layout(QString source, bool is_file, QString algo, QString render = "xdot");
+
+    //! pending job result will be discarded
+    void cancel_layout();
+
+    //! a job is pending: the worker holds the context lock for whole phases,
+    //! so layout, render, reroute_edges and load_layout are refused meanwhile
+    bool layout_running() const { return job != 0; }
+
+    //! Graphviz is not reentrant: serialize all work on context <c>
+    static QMutex* context_lock(Cp c);
+
     //! iterate functor <f> on each edge exiting <n> (access in context structure)
     void for_edges_out(Np n, Ef f, Gp g = 0) {
         if (g == 0) g = graph;
@@ -213,27 +274,103 @@ public:
     //! structure manipulation - unfold node <n>
     void unfold(Np n);
 
+    //! move node <n> to <pos> (Graphviz coordinates), keep other nodes pinned
+    //! and route again edges incident to <n>, returned in <changed>
+    bool reroute_edges(Np n, QPointF pos, edges &changed);
+
     //! debugging utility, dump graph structure to trace
     void dump(QString m);
 
-    //! make a slow linear search by now
-    Gp find_inner_subgraph(Np n, Gp g = 0);
+    //! innermost subgraph holding <n> (or 0), O(1) after first call
+    Gp inner_subgraph(Np n);
+
+    //! invalidate inner_subgraph index, after editing structure (other than by fold/unfold)
+    void structure_changed();
 
     //! attempt to remove all attrs created by XDOT rendering
     void clearXDotAttrs();
 
+    //! lookup symbols of known attributes - after rendering new ones are declared
+    void resolve_symbols();
+
+    //! symbol of <a> for objects of <kind> (AGRAPH, AGNODE, AGEDGE) in graph, 0 if undeclared
+    Sp symbol(int kind, known_attr a) const { return syms[kind][a]; }
+
+    //! symbol of <a> valid for <obj>: objects of fold buffers have their own root,
+    //! and attributes can be declared after resolve_symbols
+    Sp symbol(void *obj, known_attr a) const {
+        int k = kind_of(obj);
+        Gp root = agroot(obj);
+        Sp s = root == graph ? syms[k][a] : 0;
+        return s ? s : agattr(root, k, ccstr(known_attr_name(a)), 0);
+    }
+
+    //! value of <a> on <obj> via symbol, 0 if undeclared (as agget)
+    cstr attr(void *obj, known_attr a) const {
+        Sp s = symbol(obj, a);
+        return s ? agxget(obj, s) : 0;
+    }
+    QString attr_qs(void *obj, known_attr a) const { return QString::fromUtf8(attr(obj, a)); }
+    bool attr_on(void *obj, known_attr a) const {
+        QString v = attr_qs(obj, a);
+        return v == "yes" || v == "true";
+    }
+
+    //! set <a> on <obj> via symbol, declaring it with default <def> if required (as agsafeset)
+    int attr_set(void *obj, known_attr a, cstr value, cstr def = "");
+
+    //! map in/out edges to AGEDGE
+    static int kind_of(void *obj) {
+        int k = agobjkind(obj);
+        return k == AGINEDGE ? AGOUTEDGE : k;
+    }
+
+    //! parsed xdot programs of this graph objects, see lqXDotScene::compiled_attrs
+    struct xdot_cache {
+        struct entry {
+            //! a copy: agxset frees the old value, the new one can get the same address
+            QByteArray source;
+            QSharedPointer<xdot> prog;
+        };
+        QMutex lock;
+        QHash<void*, QVector<entry>> objects;
+    };
+    xdot_cache compiled;
+
     //! enable selective tracing from scene setup
     int trace_control;
     bool oktrace(trace_flags t) { return (trace_control & (1 << t)) == (1 << t); }
 
 signals:
 
+    //! a background job entered <phase>
+    void layout_progress(QString phase);
+
+    //! a background job completed: if <ok>, graph has been replaced
+    void layout_finished(bool ok, QString err);
+
 public slots:
 
+private slots:
+
+    void layout_done();
+
 private:
 
     Cp context;
     Gp graph;
+
+    //! the job started last, if still pending
+    lqLayoutJob *job;
+
+    //! known_attr symbols, by object kind
+    Sp syms[AGOUTEDGE + 1][n_known_attrs];
+
+    //! node to innermost subgraph, maintained by fold/unfold/copy
+    QHash<Np, Gp> clusters;
+    bool clusters_indexed;
+    void index_clusters(Gp g, Gp parent);
+    friend class lqLayoutJob;
     struct fake_edge { QString n_tail, n_head, n_save; };
 
     struct buffer {
@@ -251,11 +388,19 @@ private:
     Np copy(Np n, Gp g = 0);
     Ep copy(Ep e, Gp g = 0, bool nodes = true);
 
-    //! basic access to Graphviz error report system
-    static QStringList errors;
+    //! basic access to Graphviz error report system, errors are collected per thread
+    static QStringList& errors();
     static int store_errors(char *msg);
+    static void catch_errors();
 
     static void declattrs(Gp src, Gp dst, int kind);
+
+    //! persistent layout: visit objects in a content determined order
+    void visit_layout(std::function<void(void*, int)> f);
+    QString layout_file(QByteArray key) const;
+    static QString cache_dir;
+    static qint64 cache_limit;
+    static void prune_layout_cache();
 };
 
 #endif // LQCONTEXTGRAPH_H
@@ -0,0 +1,132 @@
+/*
+    lqXDot       : interfacing Qt and Graphviz library
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "lqLayoutJob.h"
+#include "lqXDotScene.h"
+#include <QDebug>
+
+lqLayoutJob::lqLayoutJob(Cp context, QString source, bool is_file, QString algo, QString render, QObject *parent) :
+    QThread(parent),
+    context(context),
+    source_(source),
+    is_file(is_file),
+    algo_(algo),
+    render_(render),
+    result(0)
+{
+}
+
+lqLayoutJob::~lqLayoutJob()
+{
+    wait();
+    if (result)
+        discard(true);
+}
+
+/** stop after each phase if cancelled
+ */
+void lqLayoutJob::run()
+{
+    if (is_cancelled())
+        return;
+
+    lqContextGraph::catch_errors();
+    lqContextGraph::errors().clear();
+
+    emit progress("parse");
+    {   QMutexLocker lk(lqContextGraph::context_lock(context));
+        if (is_file) {
+            if (FILE* fp = fopen(source_.toUtf8().constData(), "r")) {
+                if (!(result = agread(fp, 0)))
+                    err = tr("agread() failed: %1").arg(source_);
+                fclose(fp);
+            }
+            else
+                err = tr("cannot open file: %1").arg(source_);
+        }
+        else if (!(result = agmemread(source_.toUtf8())))
+            err = tr("agmemread() failed");
+    }
+
+    if (result && !is_cancelled())
+        layout();
+    else if (result)
+        discard(false);
+
+    QStringList &errors = lqContextGraph::errors();
+    if (!errors.isEmpty())
+        err = (err + "\n" + errors.join("\n")).trimmed();
+}
+
+/** use a temporary lqContextGraph on result, to share the persistent layout code
+ */
+void lqLayoutJob::layout()
+{
+    lqContextGraph g(context, result);
+
+    QByteArray key;
+    if (!lqContextGraph::layout_cache_dir().isEmpty())
+        key = g.layout_key(algo_);
+
+    if (!g.load_layout(key, algo_)) {
+        emit progress("layout");
+
+        // workaround multiple boxes on root, suggested by Erg
+        agsafeset(result, ccstr("_draw_"), ccstr(""), ccstr(""));
+
+        bool laid_out;
+        {   QMutexLocker lk(lqContextGraph::context_lock(context));
+            laid_out = gvLayout(context, result, algo_.toUtf8().data()) == 0;
+        }
+        if (laid_out) {
+            if (!is_cancelled()) {
+                emit progress("render");
+                QMutexLocker lk(lqContextGraph::context_lock(context));
+                if (gvRender(context, result, render_.toUtf8().data(), 0))
+                    err = tr("gvRender(%1) failed on %2").arg(render_, algo_);
+            }
+            if (err.isEmpty() && !is_cancelled())
+                g.save_layout(key);
+        }
+        else
+            err = tr("gvLayout(%1) failed").arg(algo_);
+
+        if (!err.isEmpty() || is_cancelled())
+            discard(laid_out);
+    }
+    else if (is_cancelled())
+        discard(true);
+
+    // result and context aren't owned by g
+    g.graph = 0;
+    g.context = 0;
+}
+
+/** gvFreeLayout is graph local, agclose doesn't touch context
+ */
+void lqLayoutJob::discard(bool laid_out)
+{
+    if (laid_out)
+        gvFreeLayout(context, result);
+    agclose(result);
+    result = 0;
+}
@@ -0,0 +1,89 @@
+/*
+    lqXDot       : interfacing Qt and Graphviz library
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef LQLAYOUTJOB_H
+#define LQLAYOUTJOB_H
+
+#include "lqContextGraph.h"
+#include <QThread>
+#include <QAtomicInt>
+
+/** parse, layout and render a graph on a worker thread
+  * Graphviz is not reentrant: each phase is done holding the context lock,
+  * so GUI work on current graph can interleave between phases
+  * the persistent layout cache is consulted as in lqXDotView::render_layout
+  * the resulting graph is handed to lqContextGraph only when completed
+  */
+class LQXDOTSHARED_EXPORT lqLayoutJob : public QThread, public GV_ptr_types
+{
+    Q_OBJECT
+
+public:
+
+    //! <source> is a file path if <is_file>, else a script
+    lqLayoutJob(Cp context, QString source, bool is_file, QString algo, QString render, QObject *parent = 0);
+
+    //! release an untaken result
+    ~lqLayoutJob();
+
+    //! request cancellation: Graphviz can't be interrupted, so checked between phases
+    void cancel() { cancelled.storeRelease(1); }
+    bool is_cancelled() const { return cancelled.loadAcquire() != 0; }
+
+    //! give ownership of laid out graph to caller
+    Gp take_result() { Gp g = result; result = 0; return g; }
+
+    QString source() const { return source_; }
+    QString algo() const { return algo_; }
+    QString render() const { return render_; }
+
+    //! empty if succeeded
+    QString error() const { return err; }
+
+signals:
+
+    //! entering phase "parse", "layout", "render"
+    void progress(QString phase);
+
+protected:
+
+    void run();
+
+private:
+
+    Cp context;
+    QString source_;
+    bool is_file;
+    QString algo_, render_;
+
+    QAtomicInt cancelled;
+    Gp result;
+    QString err;
+
+    //! drop partial work
+    void discard(bool laid_out);
+
+    //! layout and render result, or apply persistent layout
+    void layout();
+};
+
+#endif // LQLAYOUTJOB_H
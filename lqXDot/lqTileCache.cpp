@@ -0,0 +1,176 @@
+/*
+    lqXDot       : interfacing Qt and Graphviz library
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "lqTileCache.h"
+
+#include <qmath.h>
+#include <QPicture>
+#include <QPainter>
+#include <QtConcurrent>
+
+lqTileCache::lqTileCache(QGraphicsView *view) :
+    QObject(view),
+    view(view),
+    level(0)
+{
+    idle.setSingleShot(true);
+    idle.setInterval(0);
+    connect(&idle, SIGNAL(timeout()), SLOT(record()));
+    reset();
+}
+
+int lqTileCache::level_of(qreal scale) {
+    return qRound(4 * std::log2(scale));
+}
+qreal lqTileCache::level_scale(int level) {
+    return qPow(2, level / 4.);
+}
+QRectF lqTileCache::tile_rect(const key &k) {
+    qreal side = tile_pixels / level_scale(k.level);
+    return QRectF(k.x * side, k.y * side, side, side);
+}
+
+/** pending rasterizations will be discarded
+ */
+void lqTileCache::reset() {
+    if (scene)
+        scene->disconnect(this);
+
+    tiles.clear();
+    queued.clear();
+    foreach(auto k, running)
+        stale << k;
+
+    if ((scene = view->scene()))
+        connect(scene, SIGNAL(changed(QList<QRectF>)), SLOT(invalidate(QList<QRectF>)));
+}
+
+/** tiles are scaled to current zoom, within the level (+/- 1/8 octave)
+ */
+void lqTileCache::paint(QPainter *p, const QRect &exposed) {
+    QTransform t = view->viewportTransform();
+    level = level_of(t.m11());
+
+    p->fillRect(exposed, view->palette().brush(QPalette::Base));
+    if (!scene)
+        return;
+
+    p->setRenderHints(view->renderHints() | QPainter::SmoothPixmapTransform);
+
+    // tiles not visible at this level are not worth recording
+    for (int i = queued.size() - 1; i >= 0; --i)
+        if (queued[i].level != level)
+            queued.removeAt(i);
+
+    QRectF area = view->mapToScene(exposed).boundingRect();
+    qreal side = tile_pixels / level_scale(level);
+    int x0 = qFloor(area.left() / side), x1 = qFloor(area.right() / side),
+        y0 = qFloor(area.top() / side), y1 = qFloor(area.bottom() / side);
+
+    p->save();
+    p->setClipRect(exposed);
+    for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x) {
+            key k { level, x, y };
+            QRectF source = tile_rect(k), target = t.mapRect(source);
+            auto c = tiles.constFind(k);
+            if (c != tiles.constEnd())
+                p->drawImage(target, c.value());
+            else {
+                scene->render(p, target, source);
+                if (!queued.contains(k) && !running.key(k))
+                    queued << k;
+            }
+        }
+    p->restore();
+
+    if (!queued.isEmpty())
+        idle.start();
+}
+
+/** record some queued tiles, and rasterize them in background
+ */
+void lqTileCache::record() {
+    for (int n = 0; n < tiles_per_step && !queued.isEmpty() && scene; ++n) {
+        key k = queued.takeFirst();
+
+        QPicture picture;
+        {   QPainter p(&picture);
+            p.setRenderHints(view->renderHints());
+            scene->render(&p, QRectF(0, 0, tile_pixels, tile_pixels), tile_rect(k));
+        }
+
+        auto w = new QFutureWatcher<QImage>(this);
+        connect(w, SIGNAL(finished()), SLOT(rastered()));
+        running[w] = k;
+        w->setFuture(QtConcurrent::run([picture]() {
+            QImage image(tile_pixels, tile_pixels, QImage::Format_ARGB32_Premultiplied);
+            image.fill(Qt::transparent);
+            QPainter p(&image);
+            p.drawPicture(0, 0, picture);
+            return image;
+        }));
+    }
+    if (!queued.isEmpty())
+        idle.start();
+}
+
+/** store tile, unless scene changed under it meanwhile
+ */
+void lqTileCache::rastered() {
+    auto w = static_cast<QFutureWatcher<QImage>*>(sender());
+    key k = running.take(w);
+    w->deleteLater();
+
+    if (stale.remove(k))
+        return;
+
+    tiles[k] = w->result();
+    evict();
+    if (k.level == level)
+        view->viewport()->update(view->mapFromScene(tile_rect(k)).boundingRect());
+}
+
+void lqTileCache::invalidate(const QList<QRectF> &region) {
+    foreach(auto r, region) {
+        for (auto t = tiles.begin(); t != tiles.end(); )
+            if (tile_rect(t.key()).intersects(r))
+                t = tiles.erase(t);
+            else
+                ++t;
+        foreach(auto k, running)
+            if (tile_rect(k).intersects(r))
+                stale << k;
+    }
+}
+
+/** other levels go first
+ */
+void lqTileCache::evict() {
+    for (auto t = tiles.begin(); t != tiles.end() && tiles.size() > max_tiles; )
+        if (t.key().level != level)
+            t = tiles.erase(t);
+        else
+            ++t;
+    while (tiles.size() > max_tiles)
+        tiles.erase(tiles.begin());
+}
@@ -0,0 +1,93 @@
+/*
+    lqXDot       : interfacing Qt and Graphviz library
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef LQTILECACHE_H
+#define LQTILECACHE_H
+
+#include "lqXDot_global.h"
+
+#include <QHash>
+#include <QSet>
+#include <QImage>
+#include <QTimer>
+#include <QPointer>
+#include <QFutureWatcher>
+#include <QGraphicsView>
+
+/** rasterized scene tiles, keyed by zoom level, painted in place of items
+  * tiles are recorded (QPicture) on GUI thread when idle, then rasterized on worker threads
+  * tiles under changed scene regions are dropped
+  */
+class LQXDOTSHARED_EXPORT lqTileCache : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    lqTileCache(QGraphicsView *view);
+
+    //! tiles side in device pixels, cache size in tiles, tiles recorded each idle step
+    enum { tile_pixels = 256, max_tiles = 256, tiles_per_step = 4 };
+
+    //! paint <exposed> (viewport coordinates): missing tiles are rendered directly, and queued
+    void paint(QPainter *p, const QRect &exposed);
+
+    //! drop all tiles, follow view scene
+    void reset();
+
+public slots:
+
+    //! scene changed: drop tiles under <region>
+    void invalidate(const QList<QRectF> &region);
+
+private slots:
+
+    void record();
+    void rastered();
+
+private:
+
+    struct key {
+        int level, x, y;
+        bool operator==(const key &k) const { return level == k.level && x == k.x && y == k.y; }
+    };
+    friend uint qHash(const key &k) { return (uint(k.level) << 24) ^ (uint(k.x) << 12) ^ uint(k.y); }
+
+    //! zoom levels are quarters of octave
+    static int level_of(qreal scale);
+    static qreal level_scale(int level);
+    static QRectF tile_rect(const key &k);
+
+    QGraphicsView *view;
+    QPointer<QGraphicsScene> scene;
+
+    QHash<key, QImage> tiles;
+    QList<key> queued;
+    QHash<QFutureWatcher<QImage>*, key> running;
+    QSet<key> stale;
+    QTimer idle;
+    int level;
+
+    void evict();
+};
+
+#endif // LQTILECACHE_H
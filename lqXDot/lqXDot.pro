@@ -21,7 +21,7 @@
 #    License along with this library; if not, write to the Free Software
 #    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
-QT += core gui widgets svg
+QT += core gui widgets svg concurrent
 
 TARGET = lqXDot
 TEMPLATE = lib
@@ -47,6 +47,8 @@ SOURCES += \
     lqXDot.cpp \
     lqXDotView.cpp \
     lqXDotScene.cpp \
+    lqLayoutJob.cpp \
+    lqTileCache.cpp \
     lqGvSynCol.cpp \
     make_nop.cpp \
     SvgView.cpp
@@ -58,6 +60,8 @@ HEADERS += \
     lqXDot.h \
     lqXDotView.h \
     lqXDotScene.h \
+    lqLayoutJob.h \
+    lqTileCache.h \
     lqGvSynCol.h \
     lqXDot_configure.h \
     make_nop.h \
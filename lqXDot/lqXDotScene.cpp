@@ -21,15 +21,17 @@
 */
 
 #include "lqXDotScene.h"
-#include "lqLogger.h"
 #include "lqAniMachine.h"
 #include "lqXDotView.h"
-#include "make_nop.h"
 
 #include "lqXDot_configure.h"
 int lqXDotScene::configure_behaviour;
 
+#include <qmath.h>
 #include <QTime>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QtConcurrent>
 #include <QDebug>
 #include <QCheckBox>
 #include <QFinalState>
@@ -52,7 +54,15 @@ const int Z_FOLD = Z_NODE + 1;
 inline qreal dz(qreal &v) { v += .0001; return v; }
 
 lqXDotScene::lqXDotScene(lqContextGraph *cg) : cg(cg),
-    truecolor_()
+    truecolor_(),
+    frame(0),
+    lodLabels_(.4),
+    lodEdges_(.25),
+    lodClusters_(.15),
+    lod_labels(true),
+    lod_edges(true),
+    lod_clusters(true),
+    edge_cells_valid(false)
 {
 }
 
@@ -74,8 +84,30 @@ lqGraph* lqXDotScene::build_subgraph(Gp g, l_items items) {
 
 void lqXDotScene::build()
 {
-    truecolor_ = attr_bool(Gp(*cg), "truecolor");
-    imagepath_ = attr_str(Gp(*cg), "imagepath");
+    cg->resolve_symbols();
+    truecolor_ = cg->attr_on(Gp(*cg), lqContextGraph::ka_truecolor);
+    imagepath_ = cg->attr(Gp(*cg), lqContextGraph::ka_imagepath);
+
+    clear_index();
+    names2nodes.clear();
+    fold_marks.clear();
+    frame = 0;
+
+    // items are built at full detail
+    lod_labels = lod_edges = lod_clusters = true;
+
+    QElapsedTimer timing;
+    timing.start();
+
+    using namespace configure_behaviour;
+    bool serial = option_is_on(serial_Build);
+    if (!serial)
+        predecode();
+    qint64 decoding = timing.restart();
+
+    // bulk index rebuild is faster than incremental updates
+    ItemIndexMethod index = itemIndexMethod();
+    setItemIndexMethod(NoIndex);
 
     subgraphs(Gp(*cg), 1);
 
@@ -90,38 +122,138 @@ void lqXDotScene::build()
         }
     });
 
+    setItemIndexMethod(index);
+    predecoded.clear();
+
+    if (cg->oktrace(tf_build_timing))
+        qDebug() << "build" << (serial ? "serial" : "parallel")
+                 << "decode ms" << decoding << "items ms" << timing.elapsed() << "items" << items().count();
+
     emit setup_completed();
 }
 
-template<class T> inline T* _find(std::function<bool(T*)> f, lqXDotScene::l_items items)
+/** level of detail <lod> as from QStyleOptionGraphicsItem::levelOfDetailFromTransform
+ */
+void lqXDotScene::set_level_of_detail(qreal lod)
 {
-    foreach(QGraphicsItem *i, items)
-        if (T* I = qgraphicsitem_cast<T*>(i))
-            if (f(I))
-                return I;
-    return 0;
+    bool labels = lod >= lodLabels_,
+         edges = lod >= lodEdges_,
+         clusters = lod >= lodClusters_;
+
+    if (labels != lod_labels) {
+        foreach(auto i, nodes_index.o2i)
+            i->show_labels(labels);
+        foreach(auto i, edges_index.o2i)
+            i->show_labels(labels);
+        foreach(auto i, graphs_index.o2i)
+            i->show_labels(labels);
+        lod_labels = labels;
+    }
+    if (edges != lod_edges) {
+        foreach(auto i, edges_index.o2i)
+            i->simplify(!edges);
+        lod_edges = edges;
+    }
+    if (clusters != lod_clusters) {
+        foreach(auto i, graphs_index.o2i)
+            if (agparent(graphs_index.i2o.value(i)))
+                i->boxed(!clusters);
+        lod_clusters = clusters;
+    }
 }
 
-lqNode *lqXDotScene::find_node(Agnode_t *obj) const
+/** forget all objects <-> items associations
+ */
+void lqXDotScene::clear_index()
 {
-    return _find<lqNode>([this, obj](lqNode *i) {
-        return it_node(i) == obj;
-    }, items());
+    nodes_index.clear();
+    edges_index.clear();
+    graphs_index.clear();
+    edge_cells.clear();
+    edge_cells_valid = false;
 }
-/*
-QGraphicsItemGroup *lqXDotScene::find_edge(Agedge_t *obj) const
+
+/** register each edge in cells crossed by its route segments
+ */
+void lqXDotScene::index_edge_cells()
 {
-    return _find<QGraphicsItemGroup>([this, obj](QGraphicsItem *i) {
-        return it_edge(i) == obj;
-    }, items());
+    edge_cells.clear();
+    foreach(auto E, edges_index.o2i)
+        index_edge_cells(E);
+    edge_cells_valid = true;
 }
-QGraphicsItemGroup *lqXDotScene::find_graph(Agraph_t *obj) const
+
+/** register a single edge, at its current position
+ */
+void lqXDotScene::index_edge_cells(lqEdge *E)
 {
-    return _find<QGraphicsItemGroup>([this, obj](QGraphicsItem *i) {
-        return it_graph(i) == obj;
-    }, items());
+    foreach(auto r, E->route()) {
+        QPolygonF s = E->mapToScene(r);
+        for (int i = 1; i < s.size(); ++i) {
+            QRectF b = QRectF(s[i - 1], s[i]).normalized();
+            for (int x = qFloor(b.left() / edge_cell); x <= qFloor(b.right() / edge_cell); ++x)
+                for (int y = qFloor(b.top() / edge_cell); y <= qFloor(b.bottom() / edge_cell); ++y) {
+                    QVector<lqEdge*> &c = edge_cells[cell_key(x, y)];
+                    if (c.isEmpty() || c.last() != E)
+                        c << E;
+                }
+        }
+    }
+}
+
+/** drop <E> from cells covered by its route, before it's deleted or moved
+ */
+void lqXDotScene::unindex_edge_cells(lqEdge *E)
+{
+    QRectF b = E->mapToScene(E->route_rect()).boundingRect();
+    for (int x = qFloor(b.left() / edge_cell); x <= qFloor(b.right() / edge_cell); ++x)
+        for (int y = qFloor(b.top() / edge_cell); y <= qFloor(b.bottom() / edge_cell); ++y) {
+            auto c = edge_cells.find(cell_key(x, y));
+            if (c != edge_cells.end()) {
+                c.value().removeAll(E);
+                if (c.value().isEmpty())
+                    edge_cells.erase(c);
+            }
+        }
+}
+
+/** test only edges in cells around <p>
+ */
+lqEdge *lqXDotScene::edge_at(QPointF p, qreal tolerance)
+{
+    if (!edge_cells_valid)
+        index_edge_cells();
+
+    lqEdge *nearest = 0;
+    qreal d = tolerance;
+    QRectF a(p - QPointF(tolerance, tolerance), p + QPointF(tolerance, tolerance));
+    for (int x = qFloor(a.left() / edge_cell); x <= qFloor(a.right() / edge_cell); ++x)
+        for (int y = qFloor(a.top() / edge_cell); y <= qFloor(a.bottom() / edge_cell); ++y)
+            foreach(auto E, edge_cells.value(cell_key(x, y)))
+                if (E->isVisible() && edges_index.i2o.contains(E)) {
+                    // cheap reject before walking segments
+                    QRectF r = E->route_rect().adjusted(-d, -d, d, d);
+                    if (!r.contains(E->mapFromScene(p)))
+                        continue;
+                    qreal e = E->distance(p);
+                    if (e <= d) {
+                        d = e;
+                        nearest = E;
+                    }
+                }
+    return nearest;
+}
+
+/** nodes are identified by name: rebind survivors, drop edges and subgraphs
+ */
+void lqXDotScene::reindex_nodes()
+{
+    clear_index();
+    cg->for_nodes([this](Np n) {
+        if (lqNode *i = names2nodes.value(gvname(n)))
+            nodes_index.bind(n, i);
+    });
 }
-*/
 
 /** translate a color specification string to Qt class QColor
  *  this decode function doesn't depend on XDOT
@@ -179,7 +311,7 @@ QGraphicsItem* lqXDotScene::add_node(Np n)
                         SLOT    (itemHasChanged(QGraphicsItem::GraphicsItemChange,QVariant)));
         }
 
-        QString tooltip = QString::fromUtf8(attr_str(n, "tooltip"));
+        QString tooltip = cg->attr_qs(n, lqContextGraph::ka_tooltip);
         if (!tooltip.isEmpty()) {
             tooltip.replace("\\n", "\n");
             g->setToolTip(tooltip);
@@ -194,9 +326,12 @@ QGraphicsItem* lqXDotScene::add_node(Np n)
             QGraphicsProxyWidget *ck = addWidget(cb);
             ck->setZValue(Z_FOLD);
             ck->setPos(g->boundingRect().topLeft());
+            delete fold_marks.take(N);
+            fold_marks[N] = ck;
         }
 
         names2nodes[N] = g;
+        nodes_index.bind(n, g);
         g->setName(N);
 
         return g;
@@ -212,6 +347,9 @@ QGraphicsItem* lqXDotScene::add_edge(Ep e)
     l_items l = build_graphic(e);
     if (!l.isEmpty()) {
         lqEdge *g = build_edge(e, l);
+        edges_index.bind(AGMKOUT(e), g);
+        if (edge_cells_valid)
+            index_edge_cells(g);
         using namespace configure_behaviour;
         if (option_is_on(associate_Edges_items))
             g->setData(Edges_Items, QVariant::fromValue(e));
@@ -237,7 +375,7 @@ void lqXDotScene::subgraphs(Gp graph, qreal off_z)
         if (!option_is_on(no_draw_Graph_bounding_box)) {
             // add a fake frame around scene, like SvgView does
             bb.adjust(-5,-5,+5,+5);
-            addRect(bb, QPen(Qt::DashLine));
+            frame = addRect(bb, QPen(Qt::DashLine));
         }
         /*/ workaround multiple boxes on root graph (gvFreeLayout doesn't clear them ?)
         l = build_graphic(graph, _ldraw_); */
@@ -247,6 +385,7 @@ void lqXDotScene::subgraphs(Gp graph, qreal off_z)
 
     if (!l.isEmpty()) {
         lqGraph *ig = build_subgraph(graph, l);
+        graphs_index.bind(graph, ig);
         //ig->setData(agptr, QVariant::fromValue(graph));
         ig->setZValue(dz(off_z));
     }
@@ -254,8 +393,126 @@ void lqXDotScene::subgraphs(Gp graph, qreal off_z)
     cg->for_subgraphs([&](Gp g) { subgraphs(g, off_z); }, graph);
 }
 
+//! XDOT attributes, their symbols are lqContextGraph::known_attr with same index
 static const char *ops[] = {"_draw_", "_ldraw_", "_hdraw_", "_tdraw_", "_hldraw_", "_htdraw_"};
 
+/** resolved fonts and text extents, shared among scenes - GUI thread only
+ *  labels repeat a lot (types, modules, ...), so measure each only once
+ */
+struct text_cache {
+    struct font_key {
+        QString family;
+        qreal size;
+        int fontchar;
+        bool operator==(const font_key &k) const {
+            return family == k.family && size == k.size && fontchar == k.fontchar;
+        }
+    };
+    struct font_entry {
+        font_entry(QFont f) : font(f), metrics(f) {}
+        QFont font;
+        QFontMetricsF metrics;
+        QHash<QString, QRectF> extents;
+    };
+
+    QMutex lock;
+    QHash<QByteArray, QString> families;
+    QHash<font_key, font_entry*> fonts;
+
+    //! labels are unbounded, drop measures when too many
+    enum { max_extents = 1 << 16 };
+};
+inline uint qHash(const text_cache::font_key &k) {
+    return qHash(k.family) ^ qHash(int(k.size * 64)) ^ uint(k.fontchar << 24);
+}
+static text_cache& tcache() {
+    static text_cache c;
+    return c;
+}
+
+/** font <family> at <size> pixels, with xdot fontchar flags applied
+ *  entries are never released, their number is bounded by fonts used
+ */
+static text_cache::font_entry* text_font(QString family, qreal size, int fontchar) {
+    text_cache &c = tcache();
+    text_cache::font_key k { family, size, fontchar };
+    QMutexLocker lk(&c.lock);
+    text_cache::font_entry *&e = c.fonts[k];
+    if (!e) {
+        enum {BOLD, ITALIC, UNDERLINE, SUPERSCRIPT, SUBSCRIPT, STRIKE_THROUGH};
+        QFont font;
+        font.setFamily(family);
+        font.setPixelSize(size);
+        if (fontchar & (1 << BOLD))
+            font.setBold(true);
+        if (fontchar & (1 << ITALIC))
+            font.setItalic(true);
+        if (fontchar & (1 << UNDERLINE))
+            font.setUnderline(true);
+        if (fontchar & (1 << STRIKE_THROUGH))
+            font.setStrikeOut(true);
+        e = new text_cache::font_entry(font);
+    }
+    return e;
+}
+
+/** bounding rect of <text>, measured once for each font
+ */
+static QRectF text_rect(text_cache::font_entry *f, const QString &text) {
+    text_cache &c = tcache();
+    QMutexLocker lk(&c.lock);
+    auto p = f->extents.constFind(text);
+    if (p != f->extents.constEnd())
+        return p.value();
+    if (f->extents.size() >= text_cache::max_extents)
+        f->extents.clear();
+    return f->extents[text] = f->metrics.boundingRect(text);
+}
+
+/** parse <a>, value of XDOT attribute ops[op] of <obj>, or reuse the last parse if unchanged
+ *  entries are validated by content, as value addresses are recycled by Graphviz
+ *  parsing is done outside the lock, to allow concurrent decoding
+ */
+lqXDotScene::xdot_prog lqXDotScene::compiled_attrs(lqContextGraph *cg, void *obj, int op, cstr a)
+{
+    if (!a || !*a)
+        return xdot_prog();
+
+    lqContextGraph::xdot_cache &c = cg->compiled;
+    {   QMutexLocker lk(&c.lock);
+        auto s = c.objects.constFind(obj);
+        if (s != c.objects.constEnd()) {
+            const lqContextGraph::xdot_cache::entry &t = s.value()[op];
+            if (t.prog && t.source == a)
+                return t.prog;
+        }
+    }
+
+    xdot_prog prog(parseXDot(ccstr(a)), freeXDot);
+
+    QMutexLocker lk(&c.lock);
+    QVector<lqContextGraph::xdot_cache::entry> &s = c.objects[obj];
+    if (s.isEmpty())
+        s.resize(sizeof(ops)/sizeof(ops[0]));
+
+    lqContextGraph::xdot_cache::entry &t = s[op];
+    t.source = a;
+    t.prog = prog;
+    return prog;
+}
+
+/** drop compiled programs of <obj>, or all of <cg> if 0
+ */
+void lqXDotScene::clear_XDotCache(lqContextGraph *cg, void *obj)
+{
+    lqContextGraph::xdot_cache &c = cg->compiled;
+    QMutexLocker lk(&c.lock);
+    if (obj)
+        c.objects.remove(obj);
+    else
+        c.objects.clear();
+}
+
 /** apply XDOT attributes <b_ops> rendering to required object <obj>
  */
 void lqXDotScene::perform_attrs(void* obj, int b_ops, std::function<void(const xdot_op& op)> worker) const
@@ -264,34 +521,37 @@ void lqXDotScene::perform_attrs(void* obj, int b_ops, std::function<void(const x
         qDebug() << "perform_attrs" << b_ops;
 
     for (size_t i = 0; i < sizeof(ops)/sizeof(ops[0]); ++i)
-        if (b_ops & (1 << i)) {
-            cstr a = attr_str(obj, ops[i]);
-            if (a && *a) {
-                if (xdot *v = parseXDot(ccstr(a))) {
-                    if (cg->oktrace(tf_parseXDot))
-                        qDebug() << "parseXDot" << v->cnt << ccstr(a);
-                    for (int c = 0; c < v->cnt; ++c)
-                        worker(v->ops[c]);
-                    freeXDot(v);
-                }
+        if (b_ops & (1 << i))
+            if (xdot_prog v = compiled_attrs(cg, obj, i, cg->attr(obj, lqContextGraph::known_attr(i)))) {
+                if (cg->oktrace(tf_parseXDot))
+                    qDebug() << "parseXDot" << v->cnt << ops[i];
+                for (int c = 0; c < v->cnt; ++c)
+                    worker(v->ops[c]);
             }
-        }
 }
 
-/** remove XDOT computed rendering attributes from object
+/** remove XDOT computed rendering attributes from object, lookup by name
  */
 void lqXDotScene::clear_XDotAttrs(void *obj, int b_ops) {
-    //qDebug() << "clear_XDotAttrs" << CVP(obj) << gvname(obj);
     auto cf = [](void *obj, const char *n) {
-        //int rc = agset(obj, ccstr(n), ccstr(""));
-        /*int rc = */agsafeset(obj, ccstr(n), ccstr(""), ccstr(""));
-        /*if (cg->oktrace(tf_parseXDot))
-            qDebug() << n << rc;*/
+        agsafeset(obj, ccstr(n), ccstr(""), ccstr(""));
     };
     for (size_t i = 0; i < sizeof(ops)/sizeof(ops[0]); ++i)
         if (b_ops & (1 << i))
             cf(obj, ops[i]);
     cf(obj, "pos");
+}
+
+/** remove XDOT computed rendering attributes from object, via <cg> symbols
+ */
+void lqXDotScene::clear_XDotAttrs(lqContextGraph *cg, void *obj, int b_ops) {
+    //qDebug() << "clear_XDotAttrs" << CVP(obj) << gvname(obj);
+    for (size_t i = 0; i < sizeof(ops)/sizeof(ops[0]); ++i)
+        if (b_ops & (1 << i))
+            cg->attr_set(obj, lqContextGraph::known_attr(i), "");
+    cg->attr_set(obj, lqContextGraph::ka_pos, "");
+
+    clear_XDotCache(cg, obj);
 
     /* these don't work...
     agset(obj, ccstr("pos"), ccstr(""));
@@ -307,7 +567,6 @@ QRectF lqXDotScene::bb_rect(void *obj, int ops)
     QRectF bb;
     const char* fontname = 0;
     qreal fontsize = 0;
-    QFont font;
 
     auto poly_rect = [](const t_poly &p) {
         Q_ASSERT(p.size() > 0);
@@ -345,12 +604,7 @@ QRectF lqXDotScene::bb_rect(void *obj, int ops)
         case xd_text: {
             const xdot_text &xt = op.u.text;
             QString text(QString::fromUtf8(xt.text));
-            QString family = font_spec(fontname);
-            font.setFamily(family);
-            font.setPixelSize(fontsize);
-            QFontMetricsF fm(font);
-            QRectF tbr = fm.boundingRect(text);
-            bb = bb.united(tbr);
+            bb = bb.united(text_rect(text_font(font_spec(fontname), fontsize, 0), text));
         }   break;
         case xd_font:
             fontsize = op.u.font.size;
@@ -375,10 +629,79 @@ QRectF lqXDotScene::bb_rect(void *obj, int ops)
 
 /** this is the core of the class
   * it turns out it's *simple* to interpret xdot output commands
+  * items are built in two phases: decode (pure) and materialize (GUI thread)
   */
 lqXDotScene::l_items lqXDotScene::build_graphic(void *obj, int b_ops)
 {
-    l_items l;
+    auto p = predecoded.constFind(obj);
+    if (p != predecoded.constEnd())
+        return materialize(p.value());
+    xdot_sources src = sources(obj, b_ops);
+    return materialize(decode(obj, src, resolve_texts(obj, src)));
+}
+
+/** fetch attributes values on GUI thread, Graphviz isn't reentrant
+ */
+lqXDotScene::xdot_sources lqXDotScene::sources(void *obj, int b_ops) const
+{
+    xdot_sources src(sizeof(ops)/sizeof(ops[0]));
+    for (int i = 0; i < src.size(); ++i)
+        if (b_ops & (1 << i))
+            src[i] = cg->attr(obj, lqContextGraph::known_attr(i));
+    return src;
+}
+
+/** scan programs for text, tracking font state as decode() does
+ *  fonts are created and measured here, to keep decode() off QFont internals
+ */
+lqXDotScene::text_layouts lqXDotScene::resolve_texts(void *obj, const xdot_sources &src) const
+{
+    text_layouts texts;
+    qreal fontsize = 0;
+    int fontchar = 0;
+
+    for (int i = 0; i < src.size(); ++i)
+        if (src[i] && *src[i])
+            if (xdot_prog v = compiled_attrs(cg, obj, i, src[i]))
+                for (int c = 0; c < v->cnt; ++c) {
+                    const xdot_op &op = v->ops[c];
+                    switch (op.kind) {
+                    case xd_font:
+                        fontsize = op.u.font.size;
+                        break;
+                    case xd_fontchar: {
+                        // flags accumulate, applied by text_font()
+                        enum {BOLD, ITALIC, UNDERLINE, SUPERSCRIPT, SUBSCRIPT, STRIKE_THROUGH};
+                        fontchar |= op.u.fontchar;
+
+                        if (fontchar & (1 << SUPERSCRIPT))
+                            Q_ASSERT(false);
+                        if (fontchar & (1 << SUBSCRIPT))
+                            Q_ASSERT(false);
+                    }   break;
+                    case xd_text: {
+                        /* can't solve font properties
+                         * there could be a bug in xdot...
+                        family = font_spec(fontname), pixel size = fontsize
+                        */
+                        text_cache::font_entry *f = text_font("FreeSerif", fontsize - 1, fontchar);
+                        QString text = QString::fromUtf8(op.u.text.text).replace("\\n", "\n");
+                        texts.append(text_layout { f->font, text_rect(f, text) });
+                    }   break;
+                    default:
+                        break;
+                    }
+                }
+
+    return texts;
+}
+
+/** interpret xdot programs to a display list
+ *  <texts> are from resolve_texts(), on same sources
+ */
+lqXDotScene::display_list lqXDotScene::decode(void *obj, const xdot_sources &src, const text_layouts &texts) const
+{
+    display_list l;
 
     auto _bezier = [this](const xdot_polyline& l) {
         t_poly pts = poly_spec(l);
@@ -386,7 +709,7 @@ lqXDotScene::l_items lqXDotScene::build_graphic(void *obj, int b_ops)
         path.moveTo(pts[0]);
         for (int i = 1; i < pts.size() - 1; i += 3)
             path.cubicTo(pts[i], pts[i+1], pts[i+2]);
-        return addPath(path);
+        return path;
     };
 
     auto _gradient = [this](const xdot_color &dc) {
@@ -410,10 +733,8 @@ lqXDotScene::l_items lqXDotScene::build_graphic(void *obj, int b_ops)
     // keep state while scanning draw instructions
     QBrush brush;
     QPen pen;
-    const char* fontname = 0;
     const char* currcolor = 0;
-    qreal fontsize = 0;
-    QFont font;
+    int n_text = 0;
 
     enum {
         dashed  = 1<<0,
@@ -424,95 +745,70 @@ lqXDotScene::l_items lqXDotScene::build_graphic(void *obj, int b_ops)
     };
     int b_style = 0;
 
-    perform_attrs(obj, b_ops, [&](const xdot_op &op) {
+    auto shape = [&](display_item::kind_t k, bool filled) -> display_item& {
+        l.append(display_item());
+        display_item &d = l.last();
+        d.kind = k;
+        d.filled = filled;
+        d.pen = pen;
+        if (filled)
+            d.brush = brush;
+        return d;
+    };
+
+    auto worker = [&](const xdot_op &op) {
 
         if (cg->oktrace(tf_perform_attrs_xdot_op))
-            qDebug() << "perform_attrs" << b_ops << op.kind;
+            qDebug() << "perform_attrs" << op.kind;
 
         switch (op.kind) {
-        case xd_filled_ellipse: {
-            auto p = addEllipse(rect_spec(op.u.ellipse));
-            p->setBrush(brush);
-            p->setPen(pen);
-            l << p;
-        }   break;
-
-        case xd_unfilled_ellipse: {
-            auto p = addEllipse(rect_spec(op.u.ellipse));
-            p->setPen(pen);
-            l << p;
-        }   break;
-
-        case xd_filled_polygon: {
-            auto p = addPolygon(poly_spec(op.u.polygon));
-            p->setBrush(brush);
-            p->setPen(pen);
-            l << p;
-        }   break;
-
-        case xd_unfilled_polygon: {
-            auto p = addPolygon(poly_spec(op.u.polygon));
-            p->setPen(pen);
-            l << p;
-        }   break;
+        case xd_filled_ellipse:
+        case xd_unfilled_ellipse:
+            shape(display_item::ellipse, op.kind == xd_filled_ellipse).rect = rect_spec(op.u.ellipse);
+            break;
 
-        case xd_filled_bezier: {
-            auto p = _bezier(op.u.bezier);
-            p->setBrush(brush);
-            p->setPen(pen);
-            l << p;
-        }   break;
+        case xd_filled_polygon:
+        case xd_unfilled_polygon:
+            shape(display_item::polygon, op.kind == xd_filled_polygon).poly = poly_spec(op.u.polygon);
+            break;
 
-        case xd_unfilled_bezier: {
-            auto p = _bezier(op.u.bezier);
-            p->setPen(pen);
-            l << p;
-        }   break;
+        case xd_filled_bezier:
+        case xd_unfilled_bezier:
+            shape(display_item::path, op.kind == xd_filled_bezier).path = _bezier(op.u.bezier);
+            break;
 
-        case xd_polyline: {
-            auto p = addPolygon(poly_spec(op.u.polyline));
-            p->setPen(pen);
-            l << p;
-        }   break;
+        case xd_polyline:
+            shape(display_item::polygon, false).poly = poly_spec(op.u.polyline);
+            break;
 
         case xd_text: {
             const xdot_text &xt = op.u.text;
 
             QString text(QString::fromUtf8(xt.text));
-            QString family(font_spec(fontname));
 
-            /* can't solve font properties
-             * there could be a bug in xdot...
-            font.setFamily(family);
+            Q_ASSERT(n_text < texts.size());
+            const text_layout &f = texts[n_text++];
 
-            // set the pixel size of the font.
-            font.setPixelSize(fontsize);
-            */
-            font.setFamily("FreeSerif");
-            font.setPixelSize(fontsize-1);
-            //font.setStyleHint(QFont::Serif);
-            //font.setPixelSize(14);
-
-            QGraphicsTextItem *t = addText(text = text.replace("\\n", "\n"), font);
-            t->setDefaultTextColor(parse_color(currcolor, truecolor()));
+            display_item &t = shape(display_item::text, false);
+            t.text = text.replace("\\n", "\n");
+            t.font = f.font;
+            t.color = parse_color(currcolor, truecolor());
 
             // this is difficult to get right
-            QFontMetricsF fm(font);
-            QRectF tbr = fm.boundingRect(text);
+            QRectF tbr = f.rect;
 
             // TBD: why 3 is required ?
             switch (xt.align) {
             case xd_left:
-                t->setPos(xt.x + xt.width / 2 - 3 - tbr.width() / 2, cy(xt.y) - tbr.height());
+                t.pos = QPointF(xt.x + xt.width / 2 - 3 - tbr.width() / 2, cy(xt.y) - tbr.height());
                 break;
             case xd_center:
-                t->setPos(xt.x - 3 - tbr.width() / 2, cy(xt.y) - tbr.height());
+                t.pos = QPointF(xt.x - 3 - tbr.width() / 2, cy(xt.y) - tbr.height());
                 break;
             case xd_right:
                 Q_ASSERT(0);
                 break;
             }
-            l << t;
         }   break;
 
         case xd_fill_color:
@@ -532,8 +828,8 @@ lqXDotScene::l_items lqXDotScene::build_graphic(void *obj, int b_ops)
             break;
 
         case xd_font:
-            fontsize = op.u.font.size;
-            fontname = op.u.font.name;
+        case xd_fontchar:
+            // applied by resolve_texts()
             break;
 
         case xd_style: {
@@ -558,15 +854,11 @@ lqXDotScene::l_items lqXDotScene::build_graphic(void *obj, int b_ops)
             break;
 
         case xd_image: {
+            // pixmaps must be loaded on GUI thread
             const xdot_image &xi = op.u.image;
-            QPixmap i;
-            if (i.load(xi.name) || i.load(imagepath_ + xi.name)) {
-                QGraphicsPixmapItem *pm = new QGraphicsPixmapItem(i);
-                pm->setPos(xi.pos.x, cy(xi.pos.y + xi.pos.h));
-                l << pm;
-            }
-            else
-                qDebug() << "cannot load image" << xi.name;
+            display_item &i = shape(display_item::image, false);
+            i.text = QString::fromUtf8(xi.name);
+            i.pos = QPointF(xi.pos.x, cy(xi.pos.y + xi.pos.h));
         }   break;
 
         case xd_grad_fill_color:
@@ -576,162 +868,306 @@ lqXDotScene::l_items lqXDotScene::build_graphic(void *obj, int b_ops)
         case xd_grad_pen_color:
             pen = QPen(_gradient(op.u.grad_color), 1);
             break;
+        }
+    };
 
-        case xd_fontchar: {
-            int fontchar = op.u.fontchar;
-            enum {BOLD, ITALIC, UNDERLINE, SUPERSCRIPT, SUBSCRIPT, STRIKE_THROUGH};
-            if (fontchar & (1 << BOLD))
-                font.setBold(true);
-           if (fontchar & (1 << ITALIC))
-                font.setItalic(true);
-            if (fontchar & (1 << UNDERLINE))
-                font.setUnderline(true);
-
-            if (fontchar & (1 << SUPERSCRIPT))
-                Q_ASSERT(false);
-            if (fontchar & (1 << SUBSCRIPT))
-                Q_ASSERT(false);
-
-            if (fontchar & (1 << STRIKE_THROUGH))
-                font.setStrikeOut(true);
+    for (int i = 0; i < src.size(); ++i)
+        if (src[i] && *src[i])
+            if (xdot_prog v = compiled_attrs(cg, obj, i, src[i]))
+                for (int c = 0; c < v->cnt; ++c)
+                    worker(v->ops[c]);
+
+    return l;
+}
+
+/** add decoded primitives to scene
+ */
+lqXDotScene::l_items lqXDotScene::materialize(const display_list &dl)
+{
+    l_items l;
+
+    foreach (const display_item &d, dl) {
+        QAbstractGraphicsShapeItem *s = 0;
+        switch (d.kind) {
+        case display_item::ellipse:
+            s = addEllipse(d.rect);
+            break;
+        case display_item::polygon:
+            s = addPolygon(d.poly);
+            break;
+        case display_item::path:
+            s = addPath(d.path);
+            break;
+        case display_item::text: {
+            QGraphicsTextItem *t = addText(d.text, d.font);
+            t->setDefaultTextColor(d.color);
+            t->setPos(d.pos);
+            l << t;
+        }   break;
+        case display_item::image: {
+            QPixmap i;
+            if (i.load(d.text) || i.load(imagepath_ + d.text)) {
+                QGraphicsPixmapItem *pm = new QGraphicsPixmapItem(i);
+                pm->setPos(d.pos);
+                l << pm;
+            }
+            else
+                qDebug() << "cannot load image" << d.text;
         }   break;
         }
-    });
+        if (s) {
+            if (d.filled)
+                s->setBrush(d.brush);
+            s->setPen(d.pen);
+            l << s;
+        }
+    }
 
     return l;
 }
 
+/** decode all graph objects on thread pool
+ */
+void lqXDotScene::predecode()
+{
+    struct task {
+        void *obj;
+        xdot_sources src;
+        text_layouts texts;
+        display_list dl;
+    };
+    QVector<task> tasks;
+
+    // sources and fonts collected here, as well as scene coordinates setup
+    bbscene = graph_bb(Gp(*cg));
+    auto collect = [&](void *obj, int b_ops) {
+        xdot_sources src = sources(obj, b_ops);
+        tasks.append(task { obj, src, resolve_texts(obj, src), display_list() });
+    };
+    cg->depth_first([&](Gp g) {
+        collect(g, x_attrs_graph);
+    });
+    cg->for_nodes([&](Np n) {
+        collect(n, x_attrs_node);
+        cg->for_edges_out(n, [&](Ep e) {
+            collect(e, x_attrs_edge);
+        });
+    });
+
+    QtConcurrent::blockingMap(tasks, [this](task &t) {
+        t.dl = decode(t.obj, t.src, t.texts);
+    });
+
+    predecoded.reserve(tasks.size());
+    foreach (const task &t, tasks)
+        predecoded.insert(t.obj, t.dl);
+}
+
 /** debugging utility, dump graph structure to trace
  */
 void lqXDotScene::dump(QString m) const { cg->dump(m); }
 
-class changeScene : public lqAniMachine::cleanUpState {
+/** delete items at the end of animation
+ */
+class removeItems : public lqAniMachine::cleanUpState {
 public:
-    changeScene(lqXDotScene *s, lqXDotView *v, QPointF p, QStateMachine *m) :
-        cleanUpState(m), s(s), v(v), p(p) { }
+    removeItems(QList<QPointer<lqItem>> l, QStateMachine *m) :
+        cleanUpState(m), l(l) { }
 protected:
-    lqXDotScene *s;
-    lqXDotView *v;
-    QPointF p;
+    QList<QPointer<lqItem>> l;
     void onEntry(QEvent *event) {
-        v->setFoldedScene(s, p);
+        foreach(auto i, l)
+            delete i;
         cleanUpState::onEntry(event);
     }
 };
 
-/** compute scene animation to get a visible node <i> folded/unfolded
+/** fold/unfold a visible node <i>, updating the scene in place
  */
 lqXDotScene* lqXDotScene::fold(lqNode* i, lqXDotView *qv)
 {
+    Q_UNUSED(qv)
+
     Np n = it_node(i);   // n is undergoing folding
-    if (!n)
+    if (!n || cg->layout_running())
         return 0;
 
     QString N = gvname(n);
 
+    bool is_folded = cg->is_folded(n);
+    if (!is_folded && agfstout(*cg, n) == 0)
+        return 0;
+
+    // pointers don't survive structural changes, keep geometry by names
+    layout_snapshot before = snapshot();
+
     // mandatory to recompute...
     { bool rc = cg->freeLayout(); Q_ASSERT(rc); Q_UNUSED(rc); }
 
-    bool is_folded = cg->is_folded(n);
     if (is_folded)
         cg->unfold(n);
-    else {
-        if (agfstout(*cg, n) == 0)
-            return 0;
+    else
         cg->fold(n);
-    }
+
+    // deleted objects must not be found, nor their recycled pointers
+    reindex_nodes();
 
     if (!cg->repeatOperations())
         return 0;
 
-    auto xs = new lqXDotScene(cg);
-    xs->build();
+    update_layout(before, N);
+    return this;
+}
+
+/** geometry of current layout, by names
+ */
+lqXDotScene::layout_snapshot lqXDotScene::snapshot()
+{
+    layout_snapshot s;
+    s.height = bbscene.height();
+    QHash<QString, int> seen;
+    cg->for_nodes([&](Np n) {
+        QString name = gvname(n);
+        s.nodes[name] = layout_snapshot::node_geo { node_pos(n), node_size(n) };
+        cg->for_edges_out(n, [&](Ep e) {
+            QString key = edge_key(e, seen);
+            if (lqEdge *E = find_edge(e))
+                s.edges[key] = qMakePair(cg->attr_qs(e, lqContextGraph::ka_pos), E);
+        });
+    });
+    return s;
+}
+
+/** node center in scene coordinates
+ */
+QPointF lqXDotScene::node_pos(Np n) const
+{
+    QStringList xy = cg->attr_qs(n, lqContextGraph::ka_pos).remove('!').split(',');
+    if (xy.count() != 2)
+        return QPointF();
+    return QPointF(xy[0].toDouble(), cy(xy[1].toDouble()));
+}
+
+/** what must be unchanged to reuse a node item
+ */
+QString lqXDotScene::node_size(Np n) const
+{
+    return cg->attr_qs(n, lqContextGraph::ka_width) + ',' + cg->attr_qs(n, lqContextGraph::ka_height);
+}
+
+/** edges identity: unnamed parallel edges are told apart by occurrence,
+ *  so <seen> must be shared along a full for_nodes/for_edges_out visit
+ */
+QString lqXDotScene::edge_key(Ep e, QHash<QString, int> &seen)
+{
+    QString key = gvname(agtail(e)) + '\t' + gvname(aghead(e)) + '\t' + gvname(e);
+    return key + '\t' + QString::number(seen[key]++);
+}
 
+/** after relayout, diff against <before>:
+ *  unchanged items are moved, changed or new are built, missing are removed
+ *  <changed> node is rebuilt, and the target of removed nodes
+ */
+void lqXDotScene::update_layout(const layout_snapshot &before, QString changed)
+{
     auto am = new lqAniMachine;
+    QList<QPointer<lqItem>> removed;
+
+    // subgraphs are few, just rebuild (setting new scene coordinates)
+    foreach(auto g, graphs_index.o2i)
+        delete g;
+    graphs_index.clear();
+    delete frame;
+    frame = 0;
+    subgraphs(Gp(*cg), 1);
 
-    auto lo = new lqLogger(this, SLOT(msg(QString)), am);
-    lo->print(am, SIGNAL(finished()), "machine finished");
-
-    /*
-    QRectF R = i->boundingRect();
-    QRectF R1 = xs->names2nodes[N]->boundingRect();
-    QPointF P = R.center() - R1.center();
-
-    for (name2node::const_iterator ib = names2nodes.begin(); ib != names2nodes.end(); ++ib) {
-        lqNode *i1 = ib.value();
-        if (i1 != i) {
-            QRectF Q = i1->boundingRect();
-            name2node::const_iterator ia = xs->names2nodes.find(ib.key());
-            if (ia == xs->names2nodes.end()) {
-                // removed
-                QPointF X_p = R.center() - Q.center() + P;
-                if (!X_p.isNull()) {
-                    am->animateTargetProperty(i1, "pos", X_p);
-                    am->animateTargetProperty(i1, "opacity", 0);
-                }
-            } else {
-                // move to new position
-                QRectF Q1 = ia.value()->boundingRect();
-                QPointF X_p = R1.center() - Q1.center() + P;
-                if (!X_p.isNull())
-                    am->animateTargetProperty(i1, "pos", X_p);
-            }
-        }
-    }
+    // pos attributes are unchanged, but origin could be moved
+    QPointF dh(0, bbscene.height() - before.height);
 
-    am->run(new changeScene(xs, qv, P, am));
-    */
+    name2node old_nodes = names2nodes;
+    names2nodes.clear();
+    nodes_index.clear();
 
-    //QRectF R = i->boundingRect();
-    QRectF R1 = xs->names2nodes[N]->boundingRect();
-    //QPointF P = R1.center() - R.center();
+    qreal z_node = Z_NODE, z_edge = Z_EDGE;
 
-    foreach(auto i, items()) {
-        if (i->type() == QGraphicsItemGroup::Type)
-            i->hide();
-    }
+    auto fade_in = [&](lqItem *g) {
+        Q_ASSERT(g);
+        g->setOpacity(0);
+        am->animateTargetProperty(g, "opacity", 1);
+    };
 
-    if (!is_folded) {
-        Q_ASSERT(names2nodes.count() > xs->names2nodes.count());
-        for (name2node::const_iterator it = names2nodes.begin(); it != names2nodes.end(); ++it) {
-            QPointF X_p;
-            name2node::const_iterator ix = xs->names2nodes.find(it.key());
-            if (ix == xs->names2nodes.end()) {
-                // get folded - removed
-                X_p = R1.center() - it.value()->boundingRect().center();
-                am->animateTargetProperty(it.value(), "opacity", 0);
-            } else {
-                // move to new position
-                QRectF Q = it.value()->boundingRect();
-                QRectF Q1 = ix.value()->boundingRect();
-                X_p = Q1.center() - Q.center();
+    cg->for_nodes([&](Np n) {
+        QString name = gvname(n);
+        lqNode *o = old_nodes.take(name);
+        auto b = before.nodes.constFind(name);
+        if (o && name != changed && b != before.nodes.constEnd() && b.value().size == node_size(n)) {
+            QPointF d = node_pos(n) - b.value().pos;
+            if (!d.isNull()) {
+                am->animateTargetProperty(o, "pos", o->pos() + d);
+                if (auto ck = fold_marks.value(name))
+                    am->animateTargetProperty(ck, "pos", ck->pos() + d);
             }
-            if (!X_p.isNull())
-                am->animateTargetProperty(it.value(), "pos", X_p);
+            names2nodes[name] = o;
+            nodes_index.bind(n, o);
         }
-    }
-    else {
-        Q_ASSERT(names2nodes.count() < xs->names2nodes.count());
-        for (name2node::const_iterator ix = xs->names2nodes.begin(); ix != xs->names2nodes.end(); ++ix) {
-            QPointF X_p;
-            name2node::const_iterator it = names2nodes.find(ix.key());
-            if (it == names2nodes.end()) {
-                // get folded - removed
-                //X_p = P;
-                //am->animateTargetProperty(it.value(), "opacity", 0);
-            } else {
-                // move to new position
-                QRectF Q = it.value()->boundingRect();
-                QRectF Q1 = ix.value()->boundingRect();
-                X_p = Q1.center() - Q.center();
-                am->animateTargetProperty(it.value(), "pos", X_p);
+        else {
+            if (o) {
+                delete fold_marks.take(name);
+                delete o;
+            }
+            if (auto N = add_node(n)) {
+                N->setZValue(dz(z_node));
+                fade_in(dynamic_cast<lqItem*>(N));
             }
         }
+    });
+
+    // nodes gone collapse on changed one
+    QPointF target;
+    QByteArray changed_name = changed.toUtf8();
+    if (Np c = agnode(*cg, changed_name.data(), 0))
+        target = node_pos(c);
+    for (name2node::const_iterator it = old_nodes.begin(); it != old_nodes.end(); ++it) {
+        lqNode *o = it.value();
+        delete fold_marks.take(it.key());
+        auto b = before.nodes.constFind(it.key());
+        if (b != before.nodes.constEnd() && !target.isNull())
+            am->animateTargetProperty(o, "pos", o->pos() + target - b.value().pos);
+        am->animateTargetProperty(o, "opacity", 0);
+        removed << o;
     }
-    am->run(new changeScene(xs, qv, QPointF(), am));
-    am->start();
 
-    return xs;
+    // edges with same route are kept
+    QHash<QString, QPair<QString, lqEdge*>> old_edges = before.edges;
+    edges_index.clear();
+    edge_cells_valid = false;
+    QHash<QString, int> seen;
+    cg->for_nodes([&](Np n) {
+        cg->for_edges_out(n, [&](Ep e) {
+            auto o = old_edges.take(edge_key(e, seen));
+            if (o.second && o.first == cg->attr_qs(e, lqContextGraph::ka_pos)) {
+                if (!dh.isNull())
+                    am->animateTargetProperty(o.second, "pos", o.second->pos() + dh);
+                edges_index.bind(AGMKOUT(e), o.second);
+            }
+            else {
+                delete o.second;
+                if (auto E = add_edge(e)) {
+                    E->setZValue(dz(z_edge));
+                    fade_in(dynamic_cast<lqItem*>(E));
+                }
+            }
+        });
+    });
+    foreach(auto o, old_edges)
+        delete o.second;
+
+    // items move while animating: index final positions
+    connect(am->animation, &QParallelAnimationGroup::finished, this, [this]() {
+        index_edge_cells();
+    });
+    am->run(new removeItems(removed, am));
+    am->start();
 }
 
 /** really a logging utility
@@ -745,7 +1181,7 @@ void lqXDotScene::msg(QString m) {
 QRectF lqXDotScene::graph_bb(Gp graph)
 {
     QRectF bb;
-    QString bbs = attr_str(graph, "bb");
+    QString bbs = cg->attr(graph, lqContextGraph::ka_bb);
     if (bbs.length()) {
         qreal left, top, width, height;
         QChar s;
@@ -772,122 +1208,37 @@ void lqXDotScene::redo_objects(QList<void*> objects)
         }
 }
 
-/** WIP attempt to preserve layout and recomputing edges only
+/** preserve layout, recomputing only edges incident to the dragged node
  */
 void lqXDotScene::moveEdges(lqNode *nodeMoving, QPointF deltaPos)
 {
-    qDebug() << "moveEdges" << nodeMoving->name() << deltaPos;
-
-    cg->clearXDotAttrs();
-    QString n = nodeMoving->name();
-
+    // the graph is going to be replaced by a pending layout
     Np N = to_node(nodeMoving);
-    if (N) {
-        qDebug() << gvname(N);
-        if (agsafeset(N, ccstr("pos"), qcstr(QString("%1,%2").arg(deltaPos.x(), deltaPos.y())), ccstr("0,0")))
-            qDebug() << "failed";
+    if (!N || cg->layout_running())
+        return;
+
+    // scene y axis is flipped
+    QPointF p = node_pos(N) + deltaPos;
+    lqContextGraph::edges changed;
+    if (!cg->reroute_edges(N, QPointF(p.x(), cy(p.y())), changed))
+        return;
+
+    // bbscene is kept, so untouched items stay aligned
+    foreach(auto e, changed) {
+        lqEdge *E = find_edge(e);
+        qreal z = E ? E->zValue() : Z_EDGE;
+        edges_index.unbind(AGMKOUT(e));
+        if (E && edge_cells_valid)
+            unindex_edge_cells(E);
+        delete E;
+        if (auto R = add_edge(e)) {
+            R->setZValue(z);
+            if (lqEdge *L = qgraphicsitem_cast<lqEdge*>(R)) {
+                L->show_labels(lod_labels);
+                L->simplify(!lod_edges);
+            }
+        }
     }
-
-    #define F else qDebug() << __LINE__;
-
-    QString fdot = "/tmp/x1.dot", fneato = "/tmp/x1.neato";
-    if (gvRenderFilename(*cg, *cg, "dot", qcstr(fdot)) == 0) {
-        QFile src(fdot);
-        if (src.open(src.ReadOnly)) {
-            QString d = make_nop().transform(QTextStream(&src).readAll());
-            if (!d.isEmpty()) {
-                QString pn = "\t\"" + n + "\"\t";
-                int q = d.indexOf(pn);
-                if (q == -1)
-                    pn = "\t" + n + "\t";
-                q = d.indexOf(pn);
-                if (q > 0) {
-                    int y = d.indexOf("pos=\"", q + pn.length());
-                    if (y > 0) {
-                        int z = d.indexOf("\",\n", y + 5);
-                        if (z > 0) {
-                            QString cp = d.mid(y + 5, z - y - 5);
-                            QStringList l = cp.split(",");
-                            if (l.count() == 2) {
-                                bool ok = false;
-                                float XP = l[0].toFloat(&ok);   qDebug() << cp << l[0] << l[1] << ok;
-                                if (ok) {
-                                    float YP = l[1].toFloat(&ok);
-                                    if (ok) {
-                                        QString g = QString("%1,%2").arg(XP + deltaPos.x()).arg(YP - deltaPos.y());
-                                        QString D = d.left(y+5) + g + d.mid(z);
-                                        QFile dst(fneato);
-                                        if (dst.open(dst.WriteOnly)) {
-                                            {QTextStream(&dst) << D;}
-                                            emit reload_layout(fneato);
-                                        } F
-                                    } F
-                                } F
-                            } F
-                        } F
-                    } F
-                } F
-            } F
-        } F
-    } F
-
-    #undef F
-
-#if 0
-    /*int rf = gvRenderFilename(*cg, *cg, ccstr("plain"), ccstr("/tmp/x.plain"));
-    qDebug() << rf;
-
-    rf = gvRenderFilename(*cg, *cg, ccstr("xdot"), ccstr("/tmp/x.xdot"));
-    qDebug() << rf;
-    */
-
-    gvRenderFilename(*cg, *cg, "dot", "/tmp/x.dot");
-    cg->clearXDotAttrs();
-    gvRenderFilename(*cg, *cg, "dot", "/tmp/x1.dot");
-
-    Np n = to_node(nodeMoving);
-    QString ss(agget(n, ccstr("pos")));
-    int ps = ss.indexOf(",");
-    Q_ASSERT(ps > 0);
-    qreal   x = ss.left(ps).toFloat(),
-            y = ss.mid(ps + 1).toFloat();
-    qDebug() << ss << x << y;
-
-    //x -= delta.x();
-    y -= deltaPos.y();
-
-    QMap<Ep, QPair<Np, Np> > l_changed;
-    gvFreeLayout(*cg, *cg);
-
-    agsafeset(Gp(*cg), ccstr("splines"), ccstr("true"), ccstr(""));
-    qDebug() << agget(n, ccstr("pos"));
-    agset(n, ccstr("pos"), QString("%1,%2!").arg(x).arg(y).toUtf8().data());
-
-    auto etrace = [&](Ep e) {
-        if (!l_changed.contains(e))
-            l_changed[e] = qMakePair(agtail(e), aghead(e));
-    };
-    cg->for_edges_in(n, etrace);
-    cg->for_edges_out(n, etrace);
-
-    foreach(auto e, l_changed.keys())
-        agdeledge(*cg, e);
-
-    QList<void*> l_new;
-    foreach(auto e, l_changed.keys())
-        l_new << agedge(*cg, l_changed[e].first, l_changed[e].second, 0, 1);
-
-    gvLayout(*cg, *cg, "nop2");
-    gvRender(*cg, *cg, "xdot", 0);
-    if (cg->oktrace(tf_layout))
-        gvRenderFilename(*cg, *cg, "xdot", "/tmp/x.nop2");
-
-    //redo_objects(l_new);
-    clear();
-    build();
-
-    qDebug() << agget(n, ccstr("pos"));
-#endif
 }
 
 void lqXDotScene::itemHasChanged(QGraphicsItem::GraphicsItemChange c, QVariant v)
@@ -914,13 +1265,22 @@ void lqXDotScene::itemHasChanged(QGraphicsItem::GraphicsItemChange c, QVariant v
     }
 }
 
-/** this doesn't work, family defaulted to FreeSerif */
+/** this doesn't work, family defaulted to FreeSerif
+ *  resolved names are kept, Graphviz repeats the same few ones
+ */
 QString lqXDotScene::font_spec(cstr fontname) {
-    QString family(fontname);
+    text_cache &c = tcache();
+    QByteArray name(fontname);
+    QMutexLocker lk(&c.lock);
+    auto p = c.families.constFind(name);
+    if (p != c.families.constEnd())
+        return p.value();
+
+    QString family = QString::fromUtf8(name);
     int sep = family.indexOf('-');
     if (sep > 0)
         family = QString("%1 [%2]").arg(family.left(sep), family.mid(sep + 1));
-    return family;
+    return c.families[name] = family;
 }
 
 void lqXDotScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
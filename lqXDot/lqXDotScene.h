@@ -26,10 +26,15 @@
 #include <QGraphicsScene>
 #include <QGraphicsItem>
 #include <QPointer>
+#include <QSharedPointer>
+#include <QPainterPath>
+#include <QFont>
+#include <QPen>
 
 #include "lqContextGraph.h"
 #include "lqAobj.h"
 class lqXDotView;
+class QGraphicsProxyWidget;
 
 #include <graphviz/xdot.h>
 
@@ -43,6 +48,11 @@ class LQXDOTSHARED_EXPORT lqXDotScene : public QGraphicsScene, public GV_ptr_typ
     Q_PROPERTY(bool truecolor READ truecolor WRITE setTruecolor)
     Q_PROPERTY(QString imagepath READ imagepath WRITE setImagepath)
 
+    //! level of detail thresholds (view scale): below, use simplified representation
+    Q_PROPERTY(qreal lodLabels READ lodLabels WRITE setLodLabels)
+    Q_PROPERTY(qreal lodEdges READ lodEdges WRITE setLodEdges)
+    Q_PROPERTY(qreal lodClusters READ lodClusters WRITE setLodClusters)
+
 public:
 
     lqXDotScene(lqContextGraph *cg);
@@ -53,20 +63,54 @@ public:
     QString imagepath() const { return imagepath_; }
     void setImagepath(QString value) { imagepath_ = value; }
 
+    qreal lodLabels() const { return lodLabels_; }
+    void setLodLabels(qreal value) { lodLabels_ = value; }
+
+    qreal lodEdges() const { return lodEdges_; }
+    void setLodEdges(qreal value) { lodEdges_ = value; }
+
+    qreal lodClusters() const { return lodClusters_; }
+    void setLodClusters(qreal value) { lodClusters_ = value; }
+
+    //! switch items representation, only when crossing thresholds
+    void set_level_of_detail(qreal lod);
+
+    //! edge nearest to <p> within <tolerance> (scene coordinates), using a coarse grid
+    lqEdge *edge_at(QPointF p, qreal tolerance);
+
     static QColor parse_color(QString color, bool truecolor);
 
-    Np to_node(lqNode* n) const {
-        return agnode(*cg, qcstr(n->name()), 0);
-    }
+    //! bidirectional index between Graphviz objects and scene items
+    template<class O, class I> struct bimap {
+        QHash<O, I*> o2i;
+        QHash<I*, O> i2o;
+        void bind(O o, I* i) {
+            if (I* p = o2i.value(o)) i2o.remove(p);
+            if (i2o.contains(i)) o2i.remove(i2o.value(i));
+            o2i[o] = i;
+            i2o[i] = o;
+        }
+        void unbind(O o) { i2o.remove(o2i.take(o)); }
+        void clear() { o2i.clear(); i2o.clear(); }
+    };
+
+    Np to_node(lqNode* n) const { return nodes_index.i2o.value(n); }
     Np it_node(QGraphicsItem* i) const {
         lqNode* n = ancestor<lqNode>(i);
         return n ? to_node(n) : 0;
     }
-    lqNode *find_node(Np obj) const;
+    lqNode *find_node(Np obj) const { return nodes_index.o2i.value(obj); }
+
+    //! edges are indexed by their 'out' half
+    Ep to_edge(lqEdge* e) const { return edges_index.i2o.value(e); }
+    lqEdge *find_edge(Ep obj) const { return edges_index.o2i.value(AGMKOUT(obj)); }
+
+    Gp to_graph(lqGraph* g) const { return graphs_index.i2o.value(g); }
+    lqGraph *find_graph(Gp obj) const { return graphs_index.o2i.value(obj); }
 
     typedef QList<QGraphicsItem*> l_items;
 
-    //! change the content to get node folded/unfolded
+    //! change the content to get node folded/unfolded, updating items in place
     lqXDotScene* fold(lqNode *node, lqXDotView* v);
 
     //! dump to debugger output
@@ -102,6 +146,53 @@ protected:
     //! required when displaying images in rendered graph
     QString imagepath_;
 
+    //! dashed rectangle around scene
+    QGraphicsRectItem *frame;
+
+    //! checkboxes marking folded nodes
+    QHash<QString, QGraphicsProxyWidget*> fold_marks;
+
+    //! geometry of current layout, keyed by names: pointers don't survive structural changes
+    struct layout_snapshot {
+        qreal height;
+        struct node_geo {
+            QPointF pos;
+            QString size;
+        };
+        QHash<QString, node_geo> nodes;
+        QHash<QString, QPair<QString, lqEdge*>> edges;
+    };
+    layout_snapshot snapshot();
+
+    //! diff after relayout: move unchanged, rebuild changed, remove missing
+    void update_layout(const layout_snapshot &before, QString changed);
+
+    QPointF node_pos(Np n) const;
+    QString node_size(Np n) const;
+    static QString edge_key(Ep e, QHash<QString, int> &seen);
+
+    //! level of detail thresholds, and current representation
+    qreal lodLabels_, lodEdges_, lodClusters_;
+    bool lod_labels, lod_edges, lod_clusters;
+
+    //! objects <-> items, maintained by add_node, add_edge, subgraphs
+    bimap<Np, lqNode> nodes_index;
+    bimap<Ep, lqEdge> edges_index;
+    bimap<Gp, lqGraph> graphs_index;
+    void clear_index();
+
+    //! edges by cells of edge_cell side, built on first edge_at(), then kept per edge
+    enum { edge_cell = 64 };
+    QHash<quint64, QVector<lqEdge*>> edge_cells;
+    bool edge_cells_valid;
+    static quint64 cell_key(int x, int y) { return (quint64(quint32(x)) << 32) | quint32(y); }
+    void index_edge_cells();
+    void index_edge_cells(lqEdge *E);
+    void unindex_edge_cells(lqEdge *E);
+
+    //! after a structural change, keep only nodes still available
+    void reindex_nodes();
+
     //! constructing visual objects
     virtual QGraphicsItem* add_node(Np n);
     virtual QGraphicsItem* add_edge(Ep e);
@@ -126,12 +217,63 @@ public:
         x_attrs_graph = _draw_|_ldraw_
     };
     static void clear_XDotAttrs(void *obj, int ops);
+    static void clear_XDotAttrs(lqContextGraph *cg, void *obj, int ops);
+
+    //! a parsed xdot attribute, shared among scenes built on same layout
+    typedef QSharedPointer<xdot> xdot_prog;
+
+    //! get (parsing only once per attribute value) the program for ops[op] of <obj> in <cg>
+    //! source already fetched - doesn't access Graphviz, callable from any thread
+    static xdot_prog compiled_attrs(lqContextGraph *cg, void *obj, int op, cstr source);
+
+    //! drop compiled programs of <obj>, or all of <cg> - to release memory when layout is freed
+    static void clear_XDotCache(lqContextGraph *cg, void *obj = 0);
 
     //! change using values from lqXDot_configure.h
     static int configure_behaviour;
 
 protected:
 
+    //! a graphics primitive decoded from xdot, not yet added to scene
+    struct display_item {
+        enum kind_t { ellipse, polygon, path, text, image } kind;
+        bool filled;
+        QPen pen;
+        QBrush brush;
+        QRectF rect;
+        QPolygonF poly;
+        QPainterPath path;
+        QString text;   //! text or image name
+        QFont font;
+        QColor color;
+        QPointF pos;
+    };
+    typedef QVector<display_item> display_list;
+
+    //! XDOT attributes values of <obj>, indexed as ops, 0 when not requested
+    typedef QVector<cstr> xdot_sources;
+    xdot_sources sources(void *obj, int b_ops) const;
+
+    //! font and extent of each xd_text, in program order
+    struct text_layout {
+        QFont font;
+        QRectF rect;
+    };
+    typedef QVector<text_layout> text_layouts;
+
+    //! GUI thread: resolve fonts and measure texts, QFont isn't safe off the GUI thread
+    text_layouts resolve_texts(void *obj, const xdot_sources &src) const;
+
+    //! pure computation: can run on worker threads
+    display_list decode(void *obj, const xdot_sources &src, const text_layouts &texts) const;
+
+    //! GUI thread: add items to scene
+    l_items materialize(const display_list &dl);
+
+    //! parallel phase of build(), consumed by build_graphic
+    void predecode();
+    QHash<void*, display_list> predecoded;
+
     l_items build_graphic(void *obj, int ops);
 
     l_items build_graphic(Np obj) { return build_graphic(obj, x_attrs_node); }
@@ -167,7 +309,8 @@ protected:
     name2node names2nodes;
     name2node nodeNames() {
         name2node v;
-        cg->for_nodes([&](Np n) { v[gvname(n)] = find_node(n); });
+        for (auto i = nodes_index.o2i.constBegin(); i != nodes_index.o2i.constEnd(); ++i)
+            v[gvname(i.key())] = i.value();
         return v;
     }
 
@@ -35,6 +35,8 @@
 #include <QMenu>
 #include <QTimer>
 #include <QFileDialog>
+#include <QStyleOptionGraphicsItem>
+#include <QPaintEvent>
 
 /** actual constructor, make an empty view
  */
@@ -59,9 +61,11 @@ void lqXDotView::setup()
 {
     setTruecolor(false);
     setFoldNodes(true);
+    setAsyncLayout(false);
 
     //cg = new lqContextGraph(this);
     cg = factory_cg(this);
+    connect_cg();
 
     setRenderHint(QPainter::Antialiasing);
     setRenderHint(QPainter::TextAntialiasing);
@@ -76,10 +80,25 @@ lqXDotView::~lqXDotView()
     delete exportFmt;
 }
 
+/** forward background layout notifications
+ */
+void lqXDotView::connect_cg()
+{
+    connect(cg, SIGNAL(layout_progress(QString)), SIGNAL(layout_progress(QString)));
+    connect(cg, SIGNAL(layout_finished(bool,QString)), SLOT(layoutFinished(bool,QString)));
+}
+
 /** parse the .gv source, render in default view
+ *  when asyncLayout (default off), return true if the job has been started:
+ *  current scene stays interactive until layout is available, wait layout_finished
+ *  before accessing the rendered graph
  */
 bool lqXDotView::render_file(QString source, QString algo)
 {
+    if (asyncLayout()) {
+        setLayoutKind(algo);
+        return cg->start_layout(source, true, algo);
+    }
     return cg->run_with_error_report([&]() {
         QString err;
         if (FILE* fp = fopen(source.toUtf8().constData(), "r")) {
@@ -101,6 +120,10 @@ bool lqXDotView::render_file(QString source, QString algo)
  */
 bool lqXDotView::render_script(QString script, QString algo)
 {
+    if (asyncLayout()) {
+        setLayoutKind(algo);
+        return cg->start_layout(script, false, algo);
+    }
     return cg->run_with_error_report([&]() {
         QString err;
         if (cg->parse(script)) {
@@ -113,12 +136,23 @@ bool lqXDotView::render_script(QString script, QString algo)
     });
 }
 
+/** background layout completed: build the scene now
+ */
+void lqXDotView::layoutFinished(bool ok, QString err)
+{
+    if (ok)
+        render_graph();
+    if (!err.isEmpty())
+        critical(err);
+    emit layout_progress(QString());
+}
+
 /** apply scene translation to a built GV graph
  */
 void lqXDotView::render_graph()
 {
-    truecolor_ = attr_bool(Gp(*cg), "truecolor");
-    imagepath_ = attr_str(Gp(*cg), "imagepath");
+    truecolor_ = cg->attr_on(Gp(*cg), lqContextGraph::ka_truecolor);
+    imagepath_ = cg->attr(Gp(*cg), lqContextGraph::ka_imagepath);
 
     if (!imagepath_.isEmpty()) {
         QDir cd(imagepath_);
@@ -131,6 +165,9 @@ void lqXDotView::render_graph()
     connect(s, SIGNAL(reload_layout(QString)), SLOT(reloadLayout(QString)));
     setScene(s);
     scene()->build();
+    lod_update();
+    if (tiles)
+        tiles->reset();
 }
 
 /** very simple keyboard interaction
@@ -147,9 +184,11 @@ void lqXDotView::keyPressEvent(QKeyEvent* event)
 
     case Qt::Key_Asterisk:
         rotate(10.0);
+        lod_update();
         break;
     case Qt::Key_Slash:
         rotate(-10.0);
+        lod_update();
         break;
 
     default:
@@ -163,6 +202,7 @@ void lqXDotView::wheelEvent(QWheelEvent* event)
 {
     qreal factor = qPow(1.2, event->delta() / 240.0);
     scale(factor, factor);
+    lod_update();
     event->accept();
 }
 
@@ -170,18 +210,51 @@ void lqXDotView::mousePressEvent(QMouseEvent *event)
 {
     qDebug() << event->pos() << event->globalPos();
 
-    lqNode *lqit = ancestor<lqNode>(itemAt(event->pos()));
-    if (lqit)
+    QGraphicsItem *item = pick(event->pos());
+    if (lqNode *lqit = ancestor<lqNode>(item)) {
         qDebug() << lqit->boundingRect();
+        if (Np np = scene()->it_node(item))
+            qDebug() << lqit->name() << cg->attr_qs(np, lqContextGraph::ka_pos);
+    }
+
+    QGraphicsView::mousePressEvent(event);
+}
 
-    foreach(auto item, items(event->pos()))
-        if (QGraphicsTextItem *it = qgraphicsitem_cast<QGraphicsTextItem*>(item)) {
-            if (Np np = scene()->it_node(item))
-                qDebug() << it->toPlainText() << attr_qstr(np, "pos");
-            break;
+/** highlight edge under mouse, when not dragging
+ */
+void lqXDotView::mouseMoveEvent(QMouseEvent *event)
+{
+    if (event->buttons() == Qt::NoButton && scene()) {
+        lqEdge *e = ancestor<lqNode>(pick(event->pos())) ? 0 :
+            scene()->edge_at(mapToScene(event->pos()), pick_tolerance / transform().m11());
+        if (e != hovered) {
+            if (hovered)
+                hovered->highlight(false);
+            if ((hovered = e))
+                hovered->highlight(true);
         }
+    }
+    QGraphicsView::mouseMoveEvent(event);
+}
 
-    QGraphicsView::mousePressEvent(event);
+/** avoid exact shape() tests, slow on bezier paths
+ */
+QGraphicsItem *lqXDotView::pick(QPoint p) const
+{
+    lqXDotScene *s = scene();
+    if (!s)
+        return 0;
+
+    QGraphicsItem *other = 0;
+    foreach(auto i, items(QRect(p, QSize(1, 1)), Qt::IntersectsItemBoundingRect))
+        if (ancestor<lqNode>(i))
+            return i;
+        else if (!other && !ancestor<lqEdge>(i))
+            other = i;
+
+    if (lqEdge *e = s->edge_at(mapToScene(p), pick_tolerance / transform().m11()))
+        return e;
+    return other;
 }
 
 /** bind item menu to Fold/Unfold
@@ -195,6 +268,7 @@ void lqXDotView::addActionsItem(QMenu *menu, QGraphicsItem *item)
         else
             s = tr("&Fold");
         QAction *a = menu->addAction(s, this, SLOT(toggleFolding()));
+        a->setEnabled(!cg->layout_running());
         lqNode *N = ancestor<lqNode>(item);
         a->setData(QVariant::fromValue(N));
     }
@@ -209,6 +283,7 @@ void lqXDotView::addActionsScene(QMenu *menu)
     connect(exportFmt, SIGNAL(mapped(QString)), SLOT(exportAs(QString)));
 
     QMenu *e = menu->addMenu(tr("&Export As..."));
+    e->setEnabled(!cg->layout_running());
     foreach (auto fmt, QString("dot svg pdf png jpg").split(' ')) {
         QAction *a = e->addAction(fmt);
         connect(a, SIGNAL(triggered()), exportFmt, SLOT(map()));
@@ -221,7 +296,7 @@ void lqXDotView::addActionsScene(QMenu *menu)
 void lqXDotView::contextMenuEvent(QContextMenuEvent *event)
 {
     QMenu menu(this);
-    if (QGraphicsItem *item = itemAt(event->pos())) {
+    if (QGraphicsItem *item = pick(event->pos())) {
         addActionsItem(&menu, item);
         if (!menu.isEmpty())
             menu.addSeparator();
@@ -242,15 +317,56 @@ void lqXDotView::scale_view(qreal scaleFactor)
         scaleFactor = 0.1 / f;
 
     scale(scaleFactor, scaleFactor);
+    lod_update();
+}
+
+/** switch items representation when crossing scene thresholds
+ */
+void lqXDotView::lod_update()
+{
+    if (lqXDotScene *s = scene())
+        s->set_level_of_detail(QStyleOptionGraphicsItem::levelOfDetailFromTransform(transform()));
+}
+
+/** switch painting mode
+ */
+void lqXDotView::setTileCache(bool value)
+{
+    if (value && !tiles)
+        tiles = new lqTileCache(this);
+    if (!value && tiles)
+        delete tiles;
+    viewport()->update();
+}
+
+/** tiles assume no rotation
+ */
+void lqXDotView::paintEvent(QPaintEvent *event)
+{
+    if (tiles && scene() && !transform().isRotating()) {
+        QPainter p(viewport());
+        tiles->paint(&p, event->rect());
+    }
+    else
+        QGraphicsView::paintEvent(event);
 }
 
 /** given layout, issue xdot rendering
+ *  or apply the persistent layout of identical content
  */
 bool lqXDotView::render_layout(QString &err)
 {
+    QByteArray key;
+    if (!lqContextGraph::layout_cache_dir().isEmpty()) {
+        key = cg->layout_key(layoutKind_);
+        if (cg->load_layout(key, layoutKind_))
+            return true;
+    }
     if (cg->layout(layoutKind_)) {
-        if (cg->render("xdot"))
+        if (cg->render("xdot")) {
+            cg->save_layout(key);
             return true;
+        }
         err = tr("gvRender() xdot failed on %1").arg(layoutKind_);
     }
     else
@@ -264,6 +380,7 @@ void lqXDotView::show_context_graph_layout(GVC_t* context, Agraph_t *graph, QStr
 {
     //cg = new lqContextGraph(context, graph, this);
     cg = factory_cg(context, graph, this);
+    connect_cg();
 
     QGraphicsView::show();
 
@@ -294,7 +411,7 @@ Agraph_t* lqXDotView::getGraph() const
  */
 void lqXDotView::toggleFolding()
 {
-    if (foldNodes()) {
+    if (foldNodes() && !cg->layout_running()) {
         lqNode *i = qobject_cast<QAction*>(sender())->data().value<lqNode *>();
         lqXDotScene *s = scene()->fold(i, this);
         if (s) {
@@ -309,7 +426,8 @@ void lqXDotView::exportAs(QString fmt)
     fd.setDefaultSuffix(fmt);
     if (!lastExportDir.isEmpty())
         fd.setDirectory(lastExportDir);
-    if (fd.exec()) {
+    // a layout could have been started meanwhile
+    if (fd.exec() && !cg->layout_running()) {
         cg->clearXDotAttrs();
         QString n = fd.selectedFiles()[0];
         qDebug() << "exporting to" << n;
@@ -336,6 +454,9 @@ void lqXDotView::setFoldedScene(lqXDotScene* s, QPointF p)
     //clear();
     setScene(s);
     s->build();
+    lod_update();
+    if (tiles)
+        tiles->reset();
     //translate(p.x(), p.y());
 }
 
@@ -26,6 +26,7 @@
 
 #include "lqXDot_global.h"
 #include "lqXDotScene.h"
+#include "lqTileCache.h"
 
 #include <QGraphicsView>
 #include <QMouseEvent>
@@ -47,6 +48,12 @@ class LQXDOTSHARED_EXPORT lqXDotView : public QGraphicsView, public GV_ptr_types
     /** enable node folding */
     Q_PROPERTY(bool foldNodes READ foldNodes WRITE setFoldNodes)
 
+    /** render_file/render_script run layout in background */
+    Q_PROPERTY(bool asyncLayout READ asyncLayout WRITE setAsyncLayout)
+
+    /** paint from rasterized tiles, for large static graphs */
+    Q_PROPERTY(bool tileCache READ tileCache WRITE setTileCache)
+
 public:
 
     lqXDotView(QWidget* parent = 0);
@@ -74,6 +81,13 @@ public:
     QString layoutKind() const { return layoutKind_; }
     void setLayoutKind(QString value) { layoutKind_ = value; }
 
+    //! render_file/render_script only start the layout, completion is signalled by layout_finished
+    bool asyncLayout() const { return asyncLayout_; }
+    void setAsyncLayout(bool value) { asyncLayout_ = value; }
+
+    bool tileCache() const { return tiles != 0; }
+    void setTileCache(bool value);
+
     /** make available to scripting */
     Q_INVOKABLE void show_context_graph_layout(GVC_t* c, Agraph_t *g, QString layout);
 
@@ -88,6 +102,9 @@ signals:
 
     void report_error(QString) const;
 
+    //! background layout entered <phase>, empty when completed
+    void layout_progress(QString phase);
+
 protected:
 
     // allocation factories
@@ -102,9 +119,20 @@ protected:
     void keyPressEvent(QKeyEvent* event);
     void wheelEvent(QWheelEvent* event);
     void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void paintEvent(QPaintEvent *event);
 
     void contextMenuEvent(QContextMenuEvent *event);
 
+    //! item under viewport position <p>: nodes by bounding rect, edges by distance from route
+    QGraphicsItem *pick(QPoint p) const;
+
+    //! edges within this distance (pixels) are picked
+    enum { pick_tolerance = 4 };
+
+    //! the edge under mouse
+    QPointer<lqEdge> hovered;
+
     //! preset layout on selected algorithm
     bool render_layout(QString &err);
 
@@ -116,6 +144,7 @@ protected slots:
     void toggleFolding();
     void exportAs(QString fmt);
     void reloadLayout(QString newLayout);
+    void layoutFinished(bool ok, QString err);
 
 protected:
 
@@ -130,12 +159,24 @@ protected:
     //! scale full scene (code from SvgView)
     void scale_view(qreal scaleFactor);
 
+    //! apply scene level of detail from current transform
+    void lod_update();
+
     // when enabled, accept colors with alpha component
     bool truecolor_;
 
     // enable folding
     bool foldNodes_;
 
+    // run layout on worker thread
+    bool asyncLayout_;
+
+    // when enabled, paint from tiles
+    QPointer<lqTileCache> tiles;
+
+    //! bind signals of a newly allocated cg
+    void connect_cg();
+
     // required when displaying images in rendered graph
     QString imagepath_;
 
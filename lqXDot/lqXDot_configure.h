@@ -31,7 +31,8 @@ namespace configure_behaviour {
         move_Edges,
         associate_Edges_items,
         no_draw_Graph_bounding_box,
-        no_box_on_render_errors
+        no_box_on_render_errors,
+        serial_Build
     };
 
     inline int bit(configure_options o)  { return 1 << o; }
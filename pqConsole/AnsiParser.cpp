@@ -0,0 +1,407 @@
+/*
+    pqConsole    : interfacing SWI-Prolog and Qt
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "AnsiParser.h"
+#include "Preferences.h"
+
+/** SGR flags */
+enum {
+    Bold        = 1 << 0,
+    Faint       = 1 << 1,
+    Italic      = 1 << 2,
+    Underline   = 1 << 3,
+    DoubleUl    = 1 << 4,
+    CurlyUl     = 1 << 5,
+    Blink       = 1 << 6,
+    Inverse     = 1 << 7,
+    Hidden      = 1 << 8,
+    Strike      = 1 << 9,
+    Overline    = 1 << 10,
+
+    AnyUl = Underline|DoubleUl|CurlyUl
+};
+
+/** color spec kinds */
+enum { Indexed = 1 << 24, Rgb = 2 << 24 };
+
+/** avoid unbounded growth, i.e. on truecolor gradients */
+static const int max_formats = 4096;
+
+#define T(a, n) { AnsiParser::A_##a, AnsiParser::n }
+
+/** transitions, by state and char class:
+ *  Print   Ctrl    Bel     Esc     Digit   Semi    Colon   Private Inter   Open    Close   Final
+ */
+const AnsiParser::transition AnsiParser::table[N_States][N_Classes] = {
+    // Ground (plain text is scanned before reaching the table)
+    { T(Print, Ground), T(Print, Ground), T(None, Ground), T(None, Escape),
+      T(Print, Ground), T(Print, Ground), T(Print, Ground), T(Print, Ground),
+      T(Print, Ground), T(Print, Ground), T(Print, Ground), T(Print, Ground) },
+    // Escape
+    { T(None, Ground), T(None, Escape), T(None, Ground), T(None, Escape),
+      T(None, Ground), T(None, Ground), T(None, Ground), T(None, Ground),
+      T(None, Escape), T(Enter, Csi), T(None, Osc), T(None, Ground) },
+    // Csi
+    { T(None, CsiIgnore), T(None, Csi), T(None, Csi), T(None, Escape),
+      T(Digit, Csi), T(Next, Csi), T(Sub, Csi), T(Private, Csi),
+      T(None, CsiIgnore), T(Dispatch, Ground), T(Dispatch, Ground), T(Dispatch, Ground) },
+    // CsiIgnore
+    { T(None, CsiIgnore), T(None, CsiIgnore), T(None, CsiIgnore), T(None, Escape),
+      T(None, CsiIgnore), T(None, CsiIgnore), T(None, CsiIgnore), T(None, CsiIgnore),
+      T(None, CsiIgnore), T(None, Ground), T(None, Ground), T(None, Ground) },
+    // Osc, terminated by BEL or ST
+    { T(None, Osc), T(None, Osc), T(None, Ground), T(None, OscEsc),
+      T(None, Osc), T(None, Osc), T(None, Osc), T(None, Osc),
+      T(None, Osc), T(None, Osc), T(None, Osc), T(None, Osc) },
+    // OscEsc
+    { T(None, Ground), T(None, Ground), T(None, Ground), T(None, OscEsc),
+      T(None, Ground), T(None, Ground), T(None, Ground), T(None, Ground),
+      T(None, Ground), T(Enter, Csi), T(None, Ground), T(None, Ground) },
+};
+
+#undef T
+
+AnsiParser::class_t AnsiParser::classify(ushort c) {
+    if (c == 0x1B)
+        return C_Esc;
+    if (c == 0x07)
+        return C_Bel;
+    if (c < 0x20)
+        return C_Ctrl;
+    if (c < 0x30)
+        return C_Inter;
+    if (c <= '9')
+        return C_Digit;
+    if (c == ';')
+        return C_Semi;
+    if (c == ':')
+        return C_Colon;
+    if (c < 0x40)
+        return C_Private;
+    if (c == '[')
+        return C_Open;
+    if (c == ']')
+        return C_Close;
+    if (c < 0x7F)
+        return C_Final;
+    return C_Print;
+}
+
+AnsiParser::AnsiParser(QTextCharFormat base)
+    : state(Ground), n_params(0), is_private(false), colors(true), base(base)
+{
+    current = attrs { 0, 0, 0, 0 };
+}
+
+void AnsiParser::set_base(QTextCharFormat b) {
+    base = b;
+    clear_formats();
+}
+
+void AnsiParser::clear_formats() {
+    formats.clear();
+}
+
+/** scan plain text in bulk, only escape sequences go through the table
+ */
+void AnsiParser::parse(const QString &chunk, t_sink sink) {
+
+    QString pending;
+    QTextCharFormat fmt = format_of(current);
+
+    auto flush = [&]() {
+        if (!pending.isEmpty()) {
+            sink(pending, fmt);
+            pending.clear();
+        }
+    };
+
+    const QChar *s = chunk.constData(), *e = s + chunk.length();
+    while (s < e) {
+
+        if (state == Ground) {
+            const QChar *p = s;
+            while (p < e && p->unicode() != 0x1B && p->unicode() != 0x07)
+                ++p;
+            if (p > s)
+                pending.append(s, int(p - s));
+            if ((s = p) == e)
+                break;
+        }
+
+        ushort c = (s++)->unicode();
+        const transition &t = table[state][classify(c)];
+
+        switch (t.action) {
+        case A_Print:
+            pending.append(QChar(c));
+            break;
+        case A_Enter:
+            n_params = 1;
+            params[0] = 0;
+            sub[0] = false;
+            is_private = false;
+            break;
+        case A_Digit: {
+            int &p = params[n_params - 1];
+            p = qMin(p * 10 + (c - '0'), 0xFFFF);
+            break;
+        }
+        case A_Next:
+        case A_Sub:
+            if (n_params < max_params) {
+                params[n_params] = 0;
+                sub[n_params++] = t.action == A_Sub;
+            }
+            break;
+        case A_Private:
+            is_private = true;
+            break;
+        case A_Dispatch:
+            if (c == 'm' && !is_private) {
+                attrs before = current;
+                sgr();
+                if (!(before == current)) {
+                    flush();
+                    fmt = format_of(current);
+                }
+            }
+            break;
+        }
+
+        state = state_t(t.next);
+    }
+
+    flush();
+}
+
+/** Select Graphic Rendition
+ */
+void AnsiParser::sgr() {
+    quint16 &f = current.flags;
+
+    for (int i = 0; i < n_params; ) {
+        int p = params[i], j = i + 1;
+
+        // skip colon separated sub parameters
+        while (j < n_params && sub[j])
+            ++j;
+
+        switch (p) {
+        case 0:
+            current = attrs { 0, 0, 0, 0 };
+            break;
+        case 1:
+            f = (f & ~Faint) | Bold;
+            break;
+        case 2:
+            f = (f & ~Bold) | Faint;
+            break;
+        case 3:
+            f |= Italic;
+            break;
+        case 4:
+            f &= ~AnyUl;
+            if (j > i + 1)
+                switch (params[i + 1]) {
+                case 0:
+                    break;
+                case 2:
+                    f |= DoubleUl;
+                    break;
+                case 3:
+                    f |= CurlyUl;
+                    break;
+                default:
+                    f |= Underline;
+                }
+            else
+                f |= Underline;
+            break;
+        case 5:
+        case 6:
+            f |= Blink;
+            break;
+        case 7:
+            f |= Inverse;
+            break;
+        case 8:
+            f |= Hidden;
+            break;
+        case 9:
+            f |= Strike;
+            break;
+        case 21:
+            f = (f & ~AnyUl) | DoubleUl;
+            break;
+        case 22:
+            f &= ~(Bold|Faint);
+            break;
+        case 23:
+            f &= ~Italic;
+            break;
+        case 24:
+            f &= ~AnyUl;
+            break;
+        case 25:
+            f &= ~Blink;
+            break;
+        case 27:
+            f &= ~Inverse;
+            break;
+        case 28:
+            f &= ~Hidden;
+            break;
+        case 29:
+            f &= ~Strike;
+            break;
+        case 38:
+            j = ext_color(i, current.fg);
+            break;
+        case 39:
+            current.fg = 0;
+            break;
+        case 48:
+            j = ext_color(i, current.bg);
+            break;
+        case 49:
+            current.bg = 0;
+            break;
+        case 53:
+            f |= Overline;
+            break;
+        case 55:
+            f &= ~Overline;
+            break;
+        case 58:
+            j = ext_color(i, current.ul);
+            break;
+        case 59:
+            current.ul = 0;
+            break;
+        default:
+            if (p >= 30 && p <= 37)
+                current.fg = Indexed | (p - 30);
+            else if (p >= 40 && p <= 47)
+                current.bg = Indexed | (p - 40);
+            else if (p >= 90 && p <= 97)
+                current.fg = Indexed | (p - 90 + 8);
+            else if (p >= 100 && p <= 107)
+                current.bg = Indexed | (p - 100 + 8);
+        }
+
+        i = j;
+    }
+}
+
+/** both 38;5;N 38;2;R;G;B and the colon forms 38:5:N 38:2:[CS]:R:G:B
+ */
+int AnsiParser::ext_color(int i, quint32 &spec) const {
+    bool colon = i + 1 < n_params && sub[i + 1];
+
+    int n = i + 1;
+    if (colon)
+        while (n < n_params && sub[n])
+            ++n;
+    else
+        n = n_params;
+
+    if (i + 1 >= n)
+        return n;
+
+    int k = i + 2;
+    switch (params[i + 1]) {
+    case 5:
+        if (k < n)
+            spec = Indexed | (params[k] & 0xFF);
+        return colon ? n : qMin(k + 1, n);
+    case 2:
+        // colon form can carry a color space id
+        if (colon && n - k >= 4)
+            ++k;
+        if (k + 2 < n)
+            spec = Rgb | (qMin(params[k], 255) << 16) | (qMin(params[k + 1], 255) << 8) | qMin(params[k + 2], 255);
+        return colon ? n : qMin(k + 3, n);
+    }
+    return colon ? n : i + 2;
+}
+
+/** 16 palette colors, 6x6x6 cube, grayscale ramp, or RGB
+ */
+QColor AnsiParser::color(quint32 spec) {
+    int v = spec & 0xFFFFFF;
+    if ((spec & 0xFF000000) == Rgb)
+        return QColor((v >> 16) & 0xFF, (v >> 8) & 0xFF, v & 0xFF);
+
+    if (v < 16)
+        return Preferences::ANSI2col(v & 7, v >= 8);
+    if (v < 232) {
+        static const int level[] = { 0, 95, 135, 175, 215, 255 };
+        v -= 16;
+        return QColor(level[v / 36], level[(v / 6) % 6], level[v % 6]);
+    }
+    int g = 8 + (v - 232) * 10;
+    return QColor(g, g, g);
+}
+
+/** build a format once for each attributes combination
+ */
+const QTextCharFormat &AnsiParser::format_of(const attrs &a) {
+    if (!colors)
+        return base;
+
+    auto p = formats.constFind(a);
+    if (p != formats.constEnd())
+        return *p;
+
+    if (formats.size() >= max_formats)
+        formats.clear();
+
+    QTextCharFormat f = base;
+
+    QColor fg = a.fg ? color(a.fg) : base.foreground().color();
+    QColor bg = a.bg ? color(a.bg) : base.background().color();
+    if (a.flags & Inverse)
+        std::swap(fg, bg);
+    if (a.flags & Hidden)
+        fg = bg;
+    if (a.fg || (a.flags & (Inverse|Hidden)))
+        f.setForeground(fg);
+    if (a.bg || (a.flags & Inverse))
+        f.setBackground(bg);
+
+    f.setFontWeight(a.flags & Bold ? QFont::Bold : a.flags & Faint ? QFont::Light : QFont::Normal);
+    if (a.flags & Italic)
+        f.setFontItalic(true);
+    if (a.flags & Strike)
+        f.setFontStrikeOut(true);
+    if (a.flags & Overline)
+        f.setFontOverline(true);
+    if (a.flags & CurlyUl)
+        f.setUnderlineStyle(QTextCharFormat::WaveUnderline);
+    else if (a.flags & (Underline|DoubleUl))
+        f.setUnderlineStyle(QTextCharFormat::SingleUnderline);
+    if (a.ul)
+        f.setUnderlineColor(color(a.ul));
+
+    return formats[a] = f;
+}
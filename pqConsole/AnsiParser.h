@@ -0,0 +1,122 @@
+/*
+    pqConsole    : interfacing SWI-Prolog and Qt
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ANSIPARSER_H
+#define ANSIPARSER_H
+
+#include "pqConsole_global.h"
+
+#include <QHash>
+#include <QString>
+#include <QTextCharFormat>
+#include <functional>
+
+/** streaming decoder of ANSI terminal sequences
+ *
+ *  table driven state machine, keeps state between chunks, so a sequence
+ *  split between writes is handled. Applies the SGR set (16/256/truecolor,
+ *  bold, italic, underline styles, inverse, strike...), other sequences are dropped.
+ *  Text is delivered in runs, with formats built once per attributes combination.
+ */
+class PQCONSOLESHARED_EXPORT AnsiParser {
+public:
+
+    /** receive a run of text, all with same format */
+    typedef std::function<void(const QString &text, const QTextCharFormat &format)> t_sink;
+
+    explicit AnsiParser(QTextCharFormat base = QTextCharFormat());
+
+    /** format used for default attributes (i.e. after reset) */
+    void set_base(QTextCharFormat base);
+
+    /** when off, sequences are still removed, but text keeps base format */
+    void set_colors(bool on) { colors = on; }
+
+    /** decode a chunk of output */
+    void parse(const QString &chunk, t_sink sink);
+
+    /** forget prebuilt formats, i.e. after palette change */
+    void clear_formats();
+
+    /** SGR state */
+    struct attrs {
+        quint32 fg, bg, ul; // color spec: 0 default, else kind << 24 | value
+        quint16 flags;
+
+        bool operator==(const attrs &a) const { return fg == a.fg && bg == a.bg && ul == a.ul && flags == a.flags; }
+        friend uint qHash(const attrs &a, uint seed = 0) { return qHash(quint64(a.fg) << 32 | a.bg, seed) ^ (a.ul * 31 + a.flags); }
+    };
+
+private:
+
+    enum state_t { Ground, Escape, Csi, CsiIgnore, Osc, OscEsc, N_States };
+
+    enum class_t {
+        C_Print,    // anything printable (or not otherwise classified)
+        C_Ctrl,     // C0 controls, except ESC and BEL
+        C_Bel,
+        C_Esc,
+        C_Digit,
+        C_Semi,
+        C_Colon,
+        C_Private,  // < = > ?
+        C_Inter,    // intermediate bytes 0x20-0x2F
+        C_Open,     // [
+        C_Close,    // ]
+        C_Final,    // other final bytes 0x40-0x7E
+        N_Classes
+    };
+
+    enum action_t { A_None, A_Print, A_Enter, A_Digit, A_Next, A_Sub, A_Private, A_Dispatch };
+
+    struct transition { quint8 action, next; };
+    static const transition table[N_States][N_Classes];
+    static class_t classify(ushort c);
+
+    state_t state;
+
+    /** CSI parameters, with colon separated sub parameters marked */
+    enum { max_params = 32 };
+    int params[max_params];
+    bool sub[max_params];
+    int n_params;
+    bool is_private;
+
+    bool colors;
+    attrs current;
+    QTextCharFormat base;
+
+    /** prebuilt formats */
+    QHash<attrs, QTextCharFormat> formats;
+    const QTextCharFormat &format_of(const attrs &a);
+
+    /** apply the collected SGR parameters to current */
+    void sgr();
+
+    /** decode extended color starting at params[i] (38/48/58), return parameters consumed */
+    int ext_color(int i, quint32 &spec) const;
+
+    /** resolve a color spec */
+    static QColor color(quint32 spec);
+};
+
+#endif // ANSIPARSER_H
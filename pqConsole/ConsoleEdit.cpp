@@ -35,6 +35,7 @@
 
 #include <QUrl>
 #include <QTime>
+#include <QScrollBar>
 #include <QRegExp>
 #include <QtDebug>
 #include <QAction>
@@ -46,6 +47,7 @@
 #include <QMainWindow>
 #include <QApplication>
 #include <QStringListModel>
+#include <QAbstractTextDocumentLayout>
 
 #include <QDebug>
 
@@ -69,7 +71,6 @@ ConsoleEdit::ConsoleEdit(int argc, char **argv, QWidget *parent)
     eng = new SwiPrologEngine(this);
 
     // wire up console IO
-    connect(eng, SIGNAL(user_output(QString)), this, SLOT(user_output(QString)));
     connect(eng, SIGNAL(user_prompt(int, bool)), this, SLOT(user_prompt(int, bool)));
     connect(this, SIGNAL(user_input(QString)), eng, SLOT(user_input(QString)));
 
@@ -123,7 +124,6 @@ void ConsoleEdit::setup(Swipl_IO* io) {
     setup();
 
     // wire up console IO
-    connect(io, SIGNAL(user_output(QString)), this, SLOT(user_output(QString)));
     connect(io, SIGNAL(user_prompt(int, bool)), this, SLOT(user_prompt(int, bool)));
     connect(this, SIGNAL(user_input(QString)), io, SLOT(user_input(QString)));
 
@@ -152,9 +152,22 @@ void ConsoleEdit::setup() {
 
     Preferences p;
 
+    // engine output is pulled from the ring
+    output_high_water.storeRelease(p.console_output_high_water);
+    output_timer.setSingleShot(true);
+    connect(&output_timer, SIGNAL(timeout()), this, SLOT(output_drain()));
+
+    // bounded scrollback
+    max_lines = p.console_max_lines;
+    if (p.console_spill_history)
+        spill.reset(new ScrollbackLog);
+    spill_visible = paged_lines = 0;
+    connect(verticalScrollBar(), SIGNAL(actionTriggered(int)), this, SLOT(scrollback_action(int)));
+
     // preset presentation attributes
     output_text_fmt.setForeground(ANSI2col(p.console_out_fore));
     output_text_fmt.setBackground(ANSI2col(p.console_out_back));
+    ansi.set_base(output_text_fmt);
 
     input_text_fmt.setForeground(ANSI2col(p.console_inp_fore));
     input_text_fmt.setBackground(ANSI2col(p.console_inp_back));
@@ -325,7 +338,7 @@ void ConsoleEdit::keyPressEvent(QKeyEvent *event) {
     // case Key_Pause: I thought this one also work. It's not true.
         if (ctrl && status == running) {
             qDebug() << "^C" << thids << status;
-            PL_thread_raise(thids[0], SIGINT);
+            int_request();
             return;
         }
         // fall throu
@@ -529,6 +542,7 @@ void ConsoleEdit::insertFromMimeData(const QMimeData *source) {
  *
  *  Decode ANSI terminal sequences, to output coloured text.
  *  Colours encoding are (approx) derived from swipl console.
+ *  See AnsiParser for supported sequences.
  */
 void ConsoleEdit::user_output(QString text) {
 
@@ -544,75 +558,154 @@ void ConsoleEdit::user_output(QString text) {
         c.movePosition(QTextCursor::End);
     }
 
-    auto instext = [&](QString text) {
-        c.insertText(text, output_text_fmt);
+    // runs of text with prebuilt formats
+    ansi.set_colors(color_term);
+    ansi.parse(text, [&](const QString &run, const QTextCharFormat &format) {
+        c.insertText(run, format);
         // Jan requested extension: put messages *above* the prompt location
         if (status == wait_input) {
-            int ltext = text.length();
+            int ltext = run.length();
             promptPosition += ltext;
             fixedPosition += ltext;
-            ensureCursorVisible();
         }
-    };
+    });
+    if (status == wait_input)
+        ensureCursorVisible();
 
-    // filter and apply (some) ANSI sequence
-    int pos = text.indexOf('\x1B');
-    if (pos >= 0) {
-        int left = 0;
+    linkto_message_source();
+}
 
-        static QRegExp eseq("\x1B\\[(?:(3([0-7]);([01])m)|(0m)|(1m;)|1;3([0-7])m|(1m)|(?:3([0-7])m))");
+/** engine output available, wait a bit to coalesce more
+ */
+void ConsoleEdit::output_ready() {
+    if (!output_timer.isActive())
+        if (FlushOutputEvents *s = output_source())
+            output_timer.start(s->msec_delta_refresh);
+}
 
-        forever {
-            int pos1 = eseq.indexIn(text, pos);
-            if (pos1 == -1)
-                break;
+/** insert all pending engine output, keep it visible while running
+ */
+void ConsoleEdit::output_drain() {
+    output_timer.stop();
+    if (FlushOutputEvents *s = output_source()) {
+        QString text = s->drain();
+        if (!text.isEmpty()) {
+            user_output(text);
+            scrollback_trim();
+            if (status == running) {
+                QTextCursor c = textCursor();
+                c.movePosition(c.End);
+                setTextCursor(c);
+                ensureCursorVisible();
+            }
+        }
+    }
+}
 
-            QStringList lcap = eseq.capturedTexts();
-            Q_ASSERT(lcap.length() == 9); // match captures in eseq, 0 seems unrelated to paren
+/** keep document size bounded, evicting (and optionally spilling) old lines in bulk
+ */
+void ConsoleEdit::scrollback_trim() {
+    if (max_lines <= 0)
+        return;
 
-            // put 'out-of-band' text with current attribute, before changing it
-            instext(text.mid(left, pos1 - left));
+    if (paged_lines) {
+        // history paged in stays while the user is reading it
+        auto sb = verticalScrollBar();
+        if (sb->value() < sb->maximum())
+            return;
+        remove_head_blocks(paged_lines);
+        paged_lines = 0;
+        spill_visible = spill ? spill->count() : 0;
+    }
 
-            // map sequence to text attributes
-            QFont::Weight w;
-            QBrush c;
-            int skip = lcap[1].length();
-            if (skip) {
-                QString A = lcap[2], B = lcap[3];
-                w = QFont::Normal;
-                c = ANSI2col(B.toInt(), A == "1");
-            }
-            else if (!lcap[6].isNull()) {
-                skip  = 5;
-                w = QFont::Bold;
-                c = ANSI2col(lcap[6].toInt());
-            }
-            else if ((skip = lcap[7].length()) > 0) {
-                w = QFont::Bold;
-                c = ANSI2col(0);
-            }
-            else if (!lcap[8].isNull()) {
-                skip = 3;
-                w = QFont::Normal;
-                c = ANSI2col(lcap[8].toInt());
-            }
-            else {
-                skip = lcap[4].length() + lcap[5].length();
-                w = QFont::Normal;
-                c = ANSI2col(0);
-            }
-            output_text_fmt.setFontWeight(w);
-            output_text_fmt.setForeground(c);
+    // allow some slack, to avoid relayout for every new line
+    int excess = document()->blockCount() - max_lines;
+    if (excess <= max_lines / 8)
+        return;
 
-            left = pos = pos1 + skip + 2; // add the SCI
-        }
+    QString text = remove_head_blocks(excess);
+    if (spill) {
+        spill->append(text, excess);
+        spill_visible = spill->count();
+    }
+}
+
+/** insert at top the last spilled record not yet visible
+ */
+bool ConsoleEdit::scrollback_page_in() {
+    if (!spill || spill_visible == 0)
+        return false;
 
-        instext(text.mid(pos));
+    int n = --spill_visible, lines = spill->lines(n);
+    QString text = spill->text(n);
+
+    {   blockSig bs(this);
+        QTextCursor c(document());
+        c.insertText(text);
     }
-    else
-        instext(text);
 
-    linkto_message_source();
+    int len = text.length();
+    fixedPosition += len;
+    if (promptPosition >= 0)
+        promptPosition += len;
+    parsedStart += lines;
+    paged_lines += lines;
+
+    // keep in view what was on top
+    QTextBlock top = document()->findBlockByNumber(lines);
+    verticalScrollBar()->setValue(int(document()->documentLayout()->blockBoundingRect(top).top()));
+    return true;
+}
+
+/** remove first n blocks, return their text
+ */
+QString ConsoleEdit::remove_head_blocks(int n) {
+    QTextBlock last = document()->findBlockByNumber(n);
+    if (n <= 0 || !last.isValid())
+        return QString();
+
+    QTextCursor c(document());
+    c.setPosition(last.position(), c.KeepAnchor);
+    QString text = c.selection().toPlainText();
+
+    int len = c.selectionEnd();
+    fixedPosition = qMax(fixedPosition - len, 0);
+    if (promptPosition >= 0)
+        promptPosition = qMax(promptPosition - len, 0);
+    parsedStart = qMax(parsedStart - n, 0);
+    pmatched = ParenMatching::range();
+
+    blockSig bs(this);
+    c.removeSelectedText();
+    return text;
+}
+
+/** scrolling up while already on top
+ */
+void ConsoleEdit::scrollback_action(int action) {
+    auto sb = verticalScrollBar();
+    if (sb->value() == sb->minimum() && sb->sliderPosition() == sb->minimum())
+        switch (action) {
+        case QAbstractSlider::SliderSingleStepSub:
+        case QAbstractSlider::SliderPageStepSub:
+        case QAbstractSlider::SliderMove:
+            scrollback_page_in();
+            break;
+        }
+}
+
+/** search lines evicted from document
+ */
+QStringList ConsoleEdit::scrollback_search(QString pattern) {
+    if (spill)
+        return spill->search(QRegExp(pattern));
+    return QStringList();
+}
+
+FlushOutputEvents *ConsoleEdit::output_source() {
+    if (eng)
+        return eng;
+    return io;
 }
 
 bool ConsoleEdit::match_thread(int thread_id) const {
@@ -623,6 +716,9 @@ bool ConsoleEdit::match_thread(int thread_id) const {
  */
 void ConsoleEdit::user_prompt(int threadId, bool tty) {
 
+    // output issued before the prompt must precede it
+    output_drain();
+
     // attach thread IO to this console
     if (!thids.contains(threadId))
         thids.append(threadId);
@@ -648,51 +744,156 @@ void ConsoleEdit::user_prompt(int threadId, bool tty) {
     linkto_message_source();
 }
 
-/** resolve error messages positions
- *  but delay replacement after document' block scan
+/** hand written matcher, equivalent to
+ *    (ERROR|Warning):[ \t]*(([a-zA-Z]:)?[^:]+):([0-9]+)(:([0-9]+))?.*
+ *  get the path span in text, and the location for edit/1
  */
-void ConsoleEdit::linkto_message_source() {
+static bool message_source(const QString &text, int &beg, int &len, QString &location) {
 
-    auto c = textCursor();
-    struct to_replace_pos { int pos, len; QString html; };
-    QList<to_replace_pos> to_replace;
+    auto ascii_digit = [](QChar c) { return c >= '0' && c <= '9'; };
+    auto ascii_alpha = [](QChar c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); };
 
-    // scan blocks looking for error messages
-    for (QTextBlock block = c.document()->findBlockByNumber(parsedStart);
-         block.blockNumber() < c.document()->blockCount() - 1; block = block.next()) {
+    const QChar *s = text.constData();
+    int n = text.length(), p;
+
+    if (text.startsWith(QLatin1String("ERROR:")))
+        p = 6;
+    else if (text.startsWith(QLatin1String("Warning:")))
+        p = 8;
+    else
+        return false;
+
+    while (p < n && (s[p] == ' ' || s[p] == '\t'))
+        ++p;
+
+    // as the regex, try first with the drive letter
+    for (int drive = 1; drive >= 0; --drive) {
+        int q = p;
+        if (drive) {
+            if (!(q + 1 < n && ascii_alpha(s[q]) && s[q + 1] == ':'))
+                continue;
+            q += 2;
+        }
 
-        QString text = block.text();
-        ++parsedStart;
+        int e = q;
+        while (e < n && s[e] != ':')
+            ++e;
+        if (e == q || e == n)
+            continue;
+
+        int l = e + 1, le = l;
+        while (le < n && ascii_digit(s[le]))
+            ++le;
+        if (le == l)
+            continue;
+
+        int c = le + 1, ce = c;
+        if (le < n && s[le] == ':')
+            while (ce < n && ascii_digit(s[ce]))
+                ++ce;
+
+        QString path = text.mid(p, e - p).trimmed();
+        int opb = path.indexOf('['), clb;
+        if (opb >= 0 && (clb = path.indexOf(']', opb+1)) > opb)
+            path = path.mid(clb + 1).trimmed();
+        if (path.isEmpty())
+            return false;
+
+        beg = text.indexOf(path, p);
+        len = path.length();
+
+        location = QString("'%1':%2").arg(path, text.mid(l, le - l));
+        if (ce > c)
+            location += ":" + text.mid(c, ce - c);
+        return true;
+    }
 
-        static QRegExp jmsg("(ERROR|Warning):[ \t]*(([a-zA-Z]:)?[^:]+):([0-9]+)(:([0-9]+))?.*", Qt::CaseSensitive, QRegExp::RegExp2);
-        if (jmsg.exactMatch(text)) {
-            QStringList parts = jmsg.capturedTexts();
-            QString path = parts[2].trimmed();
-            int opb = path.indexOf('['), clb;
-            if (opb >= 0 && (clb = path.indexOf(']', opb+1)) > opb)
-                path = path.mid(clb + 1).trimmed();
+    return false;
+}
 
-            auto edit = QString("'%1':%2").arg(path).arg(parts[4].trimmed());
-            if (!parts[6].isEmpty())
-                edit += ":" + parts[6];
+/** apply <link> to error messages positions in blocks of <d> from <parsed> on
+ *  all anchors are set in a single edit block
+ */
+static void link_message_sources(QTextDocument *d, int &parsed, QTextCharFormat link) {
 
-            int pos = text.indexOf(path);
-            Q_ASSERT(pos > 0);
+    int last = d->blockCount() - 1;
+    if (parsed >= last)
+        return;
+
+    QTextCursor c(d);
+    bool editing = false;
+
+    // scan blocks looking for error messages
+    for (QTextBlock block = d->findBlockByNumber(parsed); parsed < last; block = block.next()) {
+        ++parsed;
+
+        int beg, len;
+        QString location;
+        if (message_source(block.text(), beg, len, location)) {
+            if (!editing) {
+                c.beginEditBlock();
+                editing = true;
+            }
 
             // make the source reference clickable
-            to_replace << to_replace_pos {
-                block.position() + pos, path.length(),
-                QString("<a href=\"system:edit(%1)\">%2</a>").arg(edit, path)};
+            link.setAnchorHref(QString("system:edit(%1)").arg(location));
+            c.setPosition(block.position() + beg);
+            c.setPosition(block.position() + beg + len, c.KeepAnchor);
+            c.mergeCharFormat(link);
         }
     }
 
-    // apply delayed replacement
-    foreach(auto b, to_replace) {
-        c.setPosition(b.pos);
-        c.setPosition(b.pos + b.len, c.KeepAnchor);
-        c.removeSelectedText();
-        c.insertHtml(b.html);
+    if (editing)
+        c.endEditBlock();
+}
+
+/** resolve error messages positions in blocks not yet scanned
+ *  links are applied as anchor formats
+ */
+void ConsoleEdit::linkto_message_source() {
+
+    QTextCharFormat link;
+    link.setAnchor(true);
+    link.setFontUnderline(true);
+    link.setForeground(palette().link());
+
+    link_message_sources(document(), parsedStart, link);
+}
+
+/** a make/0 output like, a warning and its detail line (not matching) for each source line
+ */
+void ConsoleEdit::message_source_timing(int lines, qint64 &scan_ms, qint64 &link_ms) const {
+
+    QStringList text;
+    for (int i = 0; i < lines; i += 2) {
+        text << QString("Warning: /home/user/src/module%1.pl:%2:").arg(i % 97).arg(i + 1);
+        text << QString("Warning:    Singleton variables: [X%1]").arg(i);
+    }
+
+    QElapsedTimer tm;
+    tm.start();
+    int found = 0;
+    foreach(QString l, text) {
+        int beg, len;
+        QString location;
+        if (message_source(l, beg, len, location))
+            ++found;
     }
+    scan_ms = tm.restart();
+
+    QTextDocument d;
+    d.setPlainText(text.join("\n"));
+    QTextCharFormat link;
+    link.setAnchor(true);
+    link.setFontUnderline(true);
+    link.setForeground(palette().link());
+
+    tm.start();
+    int parsed = 0;
+    link_message_sources(&d, parsed, link);
+    link_ms = tm.elapsed();
+
+    qDebug() << "message_source_timing" << text.size() << "lines" << found << "found";
 }
 
 /** push command on queue
@@ -888,8 +1089,14 @@ void ConsoleEdit::set_cursor_tip(QTextCursor c) {
  */
 void ConsoleEdit::int_request() {
     qDebug() << "int_request" << thids;
-    if (!thids.empty())
+    if (!thids.empty()) {
         PL_thread_raise(thids[0], SIGINT);
+        // don't wait the reader timeout
+        if (eng)
+            eng->wake_reader();
+        else if (io)
+            io->wake_reader();
+    }
 }
 
 /** serve the user menu issuing the command
@@ -934,6 +1141,8 @@ void ConsoleEdit::onConsoleMenuActionMap(const QString& action) {
 void ConsoleEdit::tty_clear() {
     clear();
     fixedPosition = promptPosition = parsedStart = 0;
+    paged_lines = 0;
+    spill_visible = spill ? spill->count() : 0;
 }
 
 /** issue instancing in GUI thread (cant moveToThread a Widget)
@@ -978,6 +1187,7 @@ void ConsoleEdit::add_history_line(QString line)
 /** when engine gracefully complete-...
  */
 void ConsoleEdit::eng_completed() {
+    output_drain();
     if (eng) {
         eng = 0;
         // qApp->quit();
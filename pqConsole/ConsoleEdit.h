@@ -24,7 +24,9 @@
 #define CONSOLEEDIT_H
 
 #include <QEvent>
+#include <QTimer>
 #include <QCompleter>
+#include <QScopedPointer>
 #include <QElapsedTimer>
 #include <QReadWriteLock>
 
@@ -46,6 +48,8 @@
 #include "SwiPrologEngine.h"
 #include "Completion.h"
 #include "ParenMatching.h"
+#include "ScrollbackLog.h"
+#include "AnsiParser.h"
 
 class Swipl_IO;
 
@@ -55,6 +59,8 @@ class Swipl_IO;
 class PQCONSOLESHARED_EXPORT ConsoleEdit : public ConsoleEditBase {
     Q_OBJECT
     Q_PROPERTY(int updateRefreshRate READ updateRefreshRate WRITE setUpdateRefreshRate)
+    Q_PROPERTY(int outputHighWater READ outputHighWater WRITE setOutputHighWater)
+    Q_PROPERTY(int scrollbackLines READ scrollbackLines WRITE setScrollbackLines)
 
 public:
 
@@ -92,6 +98,20 @@ public:
     int updateRefreshRate() const { return update_refresh_rate; }
     void setUpdateRefreshRate(int v) { update_refresh_rate = v; }
 
+    /** bytes of engine output pending before the writer thread waits - read from engine threads */
+    int outputHighWater() const { return output_high_water.loadAcquire(); }
+    void setOutputHighWater(int v) { output_high_water.storeRelease(v); }
+
+    /** lines kept in document, 0 for unbounded */
+    int scrollbackLines() const { return max_lines; }
+    void setScrollbackLines(int v) { max_lines = v; scrollback_trim(); }
+
+    /** search lines evicted from document (needs console_spill_history) */
+    QStringList scrollback_search(QString pattern);
+
+    /** time (ms) scanning <lines> of compiler warnings, then linking them in a scratch document */
+    void message_source_timing(int lines, qint64 &scan_ms, qint64 &link_ms) const;
+
     /** create a new console, bound to calling thread */
     void new_console(Swipl_IO *e, QString title);
 
@@ -152,6 +172,9 @@ public:
     /** can be disabled from ~/.swiplrc */
     static bool color_term;
 
+    /** rebuild colored formats after palette change */
+    void ansi_colors_changed() { ansi.clear_formats(); }
+
 protected:
 
     /** host actual interface object, running in background */
@@ -189,6 +212,9 @@ protected:
     /** output/input text attributes */
     QTextCharFormat output_text_fmt, input_text_fmt;
 
+    /** decode terminal sequences in output, state kept between chunks */
+    AnsiParser ansi;
+
     /** start point of engine output insertion */
     /** i.e. keep last user editable position */
     int fixedPosition;
@@ -204,6 +230,32 @@ protected:
     /** interval on count_output, determine how often to force output flushing */
     int update_refresh_rate;
 
+    /** engine output backpressure, see FlushOutputEvents::output */
+    QAtomicInt output_high_water;
+
+    /** coalesce engine output between drains */
+    QTimer output_timer;
+
+    /** the engine interface feeding this console */
+    FlushOutputEvents *output_source();
+
+    /** bounded scrollback: evicted lines optionally go to spill */
+    int max_lines;
+    QScopedPointer<ScrollbackLog> spill;
+
+    /** spill records [spill_visible, spill->count()) are paged in, for paged_lines lines */
+    int spill_visible;
+    int paged_lines;
+
+    /** evict lines exceeding max_lines, in bulk */
+    void scrollback_trim();
+
+    /** bring back last spilled record not yet visible */
+    bool scrollback_page_in();
+
+    /** remove first n blocks, keeping positions consistent */
+    QString remove_head_blocks(int n);
+
     /** autocompletion - today not context sensitive */
     /** will eventually become with help from the kernel */
     typedef QCompleter t_Completion;
@@ -280,6 +332,15 @@ public slots:
     /** 2. attempt to run generic code inter threads */
     void run_function(pfunc f) { f(); }
 
+    /** engine output available: schedule a drain */
+    void output_ready();
+
+    /** page in history when scrolling beyond top */
+    void scrollback_action(int action);
+
+    /** insert all pending engine output */
+    void output_drain();
+
 protected slots:
 
     /** send text to output */
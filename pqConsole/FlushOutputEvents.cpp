@@ -22,33 +22,67 @@
 
 #include "FlushOutputEvents.h"
 #include "ConsoleEdit.h"
-#include "do_events.h"
 
 #include <QDebug>
+#include <QTextCodec>
 #include "PREDICATE.h"
 
 FlushOutputEvents::FlushOutputEvents(ConsoleEdit *target, int msec_delta_refresh)
     : target(target),
-      msec_delta_refresh(msec_delta_refresh)
+      msec_delta_refresh(msec_delta_refresh),
+      decoder(QTextCodec::codecForName("UTF-8"))
 {
-    measure_calls.start();
+    // keep the allocation between drains
+    chunk.reserve(1 << 16);
 }
 
-void FlushOutputEvents::flush() {
-    if (target && measure_calls.elapsed() >= msec_delta_refresh) {
+/** store all bytes, then notify the GUI if not already done for this batch
+ */
+void FlushOutputEvents::output(const char *buf, size_t len) {
+    for ( ; ; ) {
+        ConsoleEdit *c = target;
+        if (!c)
+            return;
 
-        ConsoleEdit::exec_sync s;
+        // not held while waiting: a GUI thread engine must be able to put and drain
+        size_t n;
+        {   QMutexLocker lk(&put_sync);
+            n = ring.put(buf, len);
+        }
+        buf += n;
+        len -= n;
 
-        target->exec_func([&]() {
-            QTextCursor c = target->textCursor();
-            c.movePosition(c.End);
-            target->setTextCursor(c);
-            target->ensureCursorVisible();
-            do_events();
-            s.go();
-        });
-        s.stop();
+        if (drain_posted.testAndSetOrdered(0, 1))
+            QMetaObject::invokeMethod(c, "output_ready", Qt::QueuedConnection);
 
-        measure_calls.restart();
+        size_t level = qMin(size_t(qMax(c->outputHighWater(), 0)), ring.capacity() / 2);
+        if (len == 0 && ring.pending() <= level)
+            return;
+
+        // GUI thread engines (see SwiPrologEngine::in_thread) can't wait themselves
+        if (c->thread() == CT)
+            c->output_drain();
+        else
+            wait_drained(level);
     }
 }
+
+/** sleep til the consumer has brought pending output below level
+ *  a wakeup can be lost (the GUI doesn't lock), so wait with timeout
+ */
+void FlushOutputEvents::wait_drained(size_t level) {
+    QMutexLocker lk(&drained_sync);
+    while (target && ring.pending() > level)
+        drained.wait(&drained_sync, msec_delta_refresh);
+}
+
+/** clear the posted flag *before* reading, so a put racing with us will post again
+ */
+QString FlushOutputEvents::drain() {
+    drain_posted.fetchAndStoreOrdered(0);
+    chunk.resize(0);
+    if (ring.get(chunk) == 0)
+        return QString();
+    drained.wakeAll();
+    return decoder.toUnicode(chunk);
+}
@@ -24,22 +24,53 @@
 #define FLUSHOUTPUTEVENTS_H
 
 #include "pqConsole_global.h"
-#include <QElapsedTimer>
+#include "OutputRing.h"
+
+#include <QMutex>
 #include <QThread>
 #include <QPointer>
+#include <QAtomicInt>
+#include <QTextDecoder>
+#include <QWaitCondition>
 
 class ConsoleEdit;
 
 /** factorize output flushing interface
+ *
+ *  engine threads queue output bytes in a ring, without locks or allocation,
+ *  the GUI drains it in coalesced chunks on timer (see ConsoleEdit::output_drain)
  */
 struct PQCONSOLESHARED_EXPORT FlushOutputEvents {
 
     FlushOutputEvents(ConsoleEdit *target = 0, int msec_delta_refresh = 10);
-    void flush();
+
+    /** engine side: queue output, block only while pending output is above high water */
+    void output(const char *buf, size_t len);
+
+    /** GUI side: fetch and decode all pending output */
+    QString drain();
 
     QPointer<ConsoleEdit> target;
-    QElapsedTimer measure_calls;
     int msec_delta_refresh;
+
+private:
+
+    OutputRing ring;
+
+    /** the ring is single producer, but Soutput and Serror are written from any engine thread */
+    QMutex put_sync;
+
+    /** avoid posting more than a wakeup per batch */
+    QAtomicInt drain_posted;
+
+    /** backpressure: wait GUI consuming */
+    QMutex drained_sync;
+    QWaitCondition drained;
+    void wait_drained(size_t level);
+
+    /** GUI side: UTF8 sequences can be split between chunks */
+    QByteArray chunk;
+    QTextDecoder decoder;
 };
 
 #endif // FLUSHOUTPUTEVENTS_H
@@ -0,0 +1,80 @@
+/*
+    pqConsole    : interfacing SWI-Prolog and Qt
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "OutputRing.h"
+#include <cstring>
+
+OutputRing::OutputRing(size_t capacity)
+    : head(0), tail(0)
+{
+    size_t c = 1;
+    while (c < capacity)
+        c <<= 1;
+    data.resize(c);
+    mask = c - 1;
+}
+
+/** copy into free space, possibly in two slices when wrapping
+ */
+size_t OutputRing::put(const char *buf, size_t len) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+
+    size_t n = capacity() - (h - t);
+    if (n > len)
+        n = len;
+    if (n == 0)
+        return 0;
+
+    size_t p = h & mask, l = capacity() - p;
+    if (l > n)
+        l = n;
+    memcpy(&data[p], buf, l);
+    memcpy(&data[0], buf + l, n - l);
+
+    head.store(h + n, std::memory_order_release);
+    return n;
+}
+
+/** move everything available to out
+ */
+size_t OutputRing::get(QByteArray &out) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+
+    size_t n = h - t;
+    if (n == 0)
+        return 0;
+
+    size_t p = t & mask, l = capacity() - p;
+    if (l > n)
+        l = n;
+    out.append(&data[p], int(l));
+    out.append(&data[0], int(n - l));
+
+    tail.store(t + n, std::memory_order_release);
+    return n;
+}
+
+size_t OutputRing::pending() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
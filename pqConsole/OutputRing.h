@@ -0,0 +1,62 @@
+/*
+    pqConsole    : interfacing SWI-Prolog and Qt
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef OUTPUTRING_H
+#define OUTPUTRING_H
+
+#include "pqConsole_global.h"
+#include <QByteArray>
+#include <atomic>
+#include <vector>
+
+/** single producer / single consumer byte ring
+ *  producer is the Prolog thread write callback, consumer the GUI thread:
+ *  no locks and no allocation after construction
+ *  concurrent producers must be serialized by the caller (see FlushOutputEvents::output)
+ */
+class PQCONSOLESHARED_EXPORT OutputRing {
+public:
+
+    /** capacity is rounded to a power of 2 */
+    explicit OutputRing(size_t capacity = 1 << 20);
+
+    /** producer: append up to len bytes, return how many have been stored */
+    size_t put(const char *buf, size_t len);
+
+    /** consumer: append all available bytes to out, return how many */
+    size_t get(QByteArray &out);
+
+    /** bytes stored and not yet consumed */
+    size_t pending() const;
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+
+    std::vector<char> data;
+    size_t mask;
+
+    /** free running counters, written only by producer (head) and consumer (tail) */
+    std::atomic<size_t> head, tail;
+};
+
+#endif // OUTPUTRING_H
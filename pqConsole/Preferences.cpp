@@ -46,6 +46,11 @@ Preferences::Preferences(QObject *parent) :
     console_inp_fore = value("console_inp_fore", 0).toInt();
     console_inp_back = value("console_inp_back", 15).toInt();
 
+    console_output_high_water = value("console_output_high_water", 1 << 18).toInt();
+
+    console_max_lines = value("console_max_lines", 20000).toInt();
+    console_spill_history = value("console_spill_history", false).toBool();
+
     //tab_size = value("tab_size", 80).toInt();
 
     // selection from SVG named colors
@@ -94,6 +99,11 @@ void Preferences::save() {
     SV(console_inp_fore);
     SV(console_inp_back);
 
+    SV(console_output_high_water);
+
+    SV(console_max_lines);
+    SV(console_spill_history);
+
     //SV(tab_size);
 
     #undef SV
@@ -57,6 +57,13 @@ public:
     int console_inp_fore;
     int console_inp_back;
 
+    /** engine output pending (bytes) before the writer thread waits the GUI */
+    int console_output_high_water;
+
+    /** scrollback cap (lines, 0 = unbounded), evicted lines optionally spilled to disk */
+    int console_max_lines;
+    bool console_spill_history;
+
     /** enable a scroll bar when not wrapped */
     ConsoleEditBase::LineWrapMode wrapMode;
 
@@ -0,0 +1,71 @@
+/*
+    pqConsole    : interfacing SWI-Prolog and Qt
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "ScrollbackLog.h"
+#include <QDir>
+#include <QDebug>
+
+ScrollbackLog::ScrollbackLog()
+    : file(QDir::tempPath() + "/pqConsole_scrollback_XXXXXX")
+{
+}
+
+/** compress and append at end of file
+ */
+bool ScrollbackLog::append(QString text, int lines) {
+    if (!file.isOpen() && !file.open()) {
+        qDebug() << "ScrollbackLog: can't open" << file.fileName();
+        return false;
+    }
+
+    QByteArray z = qCompress(text.toUtf8());
+    record r = { file.size(), z.size(), lines };
+    file.seek(r.offset);
+    if (file.write(z) != z.size())
+        return false;
+
+    index.append(r);
+    return true;
+}
+
+/** read back and decompress a record
+ */
+QString ScrollbackLog::text(int n) {
+    const record &r = index[n];
+    if (!file.seek(r.offset))
+        return QString();
+    return QString::fromUtf8(qUncompress(file.read(r.size)));
+}
+
+/** scan records sequentially, one at time in memory
+ */
+QStringList ScrollbackLog::search(QRegExp pattern, int max_matches) {
+    QStringList matches;
+    for (int n = 0; n < count() && matches.count() < max_matches; ++n)
+        foreach (QString line, text(n).split('\n', QString::SkipEmptyParts))
+            if (line.contains(pattern)) {
+                matches.append(line);
+                if (matches.count() == max_matches)
+                    break;
+            }
+    return matches;
+}
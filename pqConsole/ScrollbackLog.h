@@ -0,0 +1,66 @@
+/*
+    pqConsole    : interfacing SWI-Prolog and Qt
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SCROLLBACKLOG_H
+#define SCROLLBACKLOG_H
+
+#include "pqConsole_global.h"
+
+#include <QVector>
+#include <QRegExp>
+#include <QStringList>
+#include <QTemporaryFile>
+
+/** console lines evicted from the document, kept compressed on disk
+ *  records are appended in output order, and can be read back
+ *  (to page in history on scroll) or searched
+ */
+class PQCONSOLESHARED_EXPORT ScrollbackLog {
+public:
+
+    ScrollbackLog();
+
+    /** store a block of lines (text ends with newline) */
+    bool append(QString text, int lines);
+
+    /** number of records stored */
+    int count() const { return index.count(); }
+
+    /** number of lines in record */
+    int lines(int record) const { return index[record].lines; }
+
+    /** decompress a record */
+    QString text(int record);
+
+    /** lines of all records matching pattern, oldest first */
+    QStringList search(QRegExp pattern, int max_matches = 1000);
+
+private:
+
+    /** lazily created, removed at destruction */
+    QTemporaryFile file;
+
+    struct record { qint64 offset; int size; int lines; };
+    QVector<record> index;
+};
+
+#endif // SCROLLBACKLOG_H
@@ -76,6 +76,14 @@ void SwiPrologEngine::start(int argc, char **argv) {
 void SwiPrologEngine::user_input(QString s) {
     QMutexLocker lk(&sync);
     buffer = s.toUtf8();
+    input_ready.wakeAll();
+}
+
+/** the reader sleeps on input_ready, make it check signals now
+ */
+void SwiPrologEngine::wake_reader() {
+    QMutexLocker lk(&sync);
+    input_ready.wakeAll();
 }
 
 /** fill the buffer
@@ -87,6 +95,8 @@ ssize_t SwiPrologEngine::_read_(void *handle, char *buf, size_t bufsize) {
 }
 
 /** background read & query loop
+ *  sleep til input or query is available, waking up
+ *  periodically to serve Prolog signals
  */
 ssize_t SwiPrologEngine::_read_(char *buf, size_t bufsize) {
 
@@ -95,32 +105,46 @@ ssize_t SwiPrologEngine::_read_(char *buf, size_t bufsize) {
 
     for ( ; ; ) {
 
+        QList<query> todo;
+
         {   QMutexLocker lk(&sync);
 
             if (!spe) // terminated
                 return 0;
 
-            if (!queries.empty())
-                serve_query(queries.takeFirst());
-
-            uint n = buffer.length();
-            if (n > 0) {
-                uint l = bufsize < n ? bufsize : n;
-                memcpy(buf, buffer, l);
-                buffer.remove(0, l);
-                return l;
-            }
+            auto ready = [&]() {
+                return !queries.empty() || !buffer.isEmpty() || (target && target->status == ConsoleEdit::eof);
+            };
+            if (!ready())
+                input_ready.wait(&sync, signals_poll_ms);
 
-            if (target && target->status == ConsoleEdit::eof) {
-                target->status = ConsoleEdit::running;
+            if (!spe)
                 return 0;
+
+            if (!queries.empty())
+                todo.append(queries.takeFirst());
+            else {
+                uint n = buffer.length();
+                if (n > 0) {
+                    uint l = bufsize < n ? bufsize : n;
+                    memcpy(buf, buffer, l);
+                    buffer.remove(0, l);
+                    return l;
+                }
+
+                if (target && target->status == ConsoleEdit::eof) {
+                    target->status = ConsoleEdit::running;
+                    return 0;
+                }
             }
         }
 
+        // don't hold the lock while running Prolog code
+        if (!todo.empty())
+            serve_query(todo.takeFirst());
+
         if (PL_handle_signals() < 0)
             return -1;
-
-        //msleep(100);
     }
 }
 
@@ -158,11 +182,8 @@ void SwiPrologEngine::serve_query(query p) {
  */
 ssize_t SwiPrologEngine::_write_(void *handle, char *buf, size_t bufsize) {
     Q_UNUSED(handle);
-    if (spe) {   // not terminated?
-        emit spe->user_output(QString::fromUtf8(buf, bufsize));
-        if (spe->target && spe->target->status == ConsoleEdit::running)
-            spe->flush();
-    }
+    if (spe)    // not terminated?
+        spe->output(buf, bufsize);
     return bufsize;
 }
 
@@ -249,6 +270,7 @@ void SwiPrologEngine::query_run(QString text) {
 #else
     queries.append(query(false, "", text));
 #endif
+    input_ready.wakeAll();
 }
 
 /** push a named query, thus unlocking the execution polling loop
@@ -260,6 +282,7 @@ void SwiPrologEngine::query_run(QString module, QString text) {
 #else
     queries.append(query(false, module, text));
 #endif
+    input_ready.wakeAll();
 }
 
 /** allows to run a delayed script from resource at startup
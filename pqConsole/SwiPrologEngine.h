@@ -87,6 +87,12 @@ public:
     /** utility: make public */
     static void msleep(unsigned long n) { QThread::msleep(n); }
 
+    /** longest wait for input before serving pending Prolog signals */
+    static const unsigned long signals_poll_ms = 100;
+
+    /** let the reader serve a signal just raised (see PL_thread_raise) */
+    void wake_reader();
+
     /** query engine about expected interface */
     static bool is_tty(const FlushOutputEvents *target = 0);
 
@@ -95,9 +101,6 @@ public:
 
 signals:
 
-    /** issued to queue a string to user output */
-    void user_output(QString output);
-
     /** issued to peek input - til to CR - from user */
     void user_prompt(int threadId, bool tty);
 
@@ -136,6 +139,9 @@ protected:
     QByteArray buffer;      // syncronized !
     QList<query> queries;   // syncronized !
 
+    /** signaled when buffer or queries change */
+    QWaitCondition input_ready;
+
     void serve_query(query q);
 
     static ssize_t _read_(void *handle, char *buf, size_t bufsize);
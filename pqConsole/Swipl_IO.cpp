@@ -40,10 +40,7 @@ ssize_t Swipl_IO::_read_f(void *handle, char *buf, size_t bufsize) {
 /** empty the buffer */
 ssize_t Swipl_IO::_write_f(void *handle, char* buf, size_t bufsize) {
     auto e = pq_cast<Swipl_IO>(handle);
-    if (e->target) {
-        emit e->user_output(QString::fromUtf8(buf, bufsize));
-        e->flush();
-    }
+    e->output(buf, bufsize);
     return bufsize;
 }
 
@@ -77,7 +74,7 @@ int64_t Swipl_IO::_seek64_f(void *handle, int64_t pos, int whence) {
     return 0;
 }
 
-/** polling loop til buffer ready
+/** wait til buffer ready
  */
 ssize_t Swipl_IO::_read_(char *buf, size_t bufsize) {
 
@@ -87,6 +84,8 @@ ssize_t Swipl_IO::_read_(char *buf, size_t bufsize) {
     // handle setup interthread and termination
     for ( ; ; ) {
         {   QMutexLocker lk(&sync);
+            if (!target)
+                input_ready.wait(&sync, SwiPrologEngine::signals_poll_ms);
             if (target) {
                 if (!target->thids.contains(thid)) {
                     target->add_thread(thid);
@@ -100,8 +99,6 @@ ssize_t Swipl_IO::_read_(char *buf, size_t bufsize) {
 
 	if ( PL_handle_signals() < 0 )
 	    return -1;
-
-        SwiPrologEngine::msleep(10);
     }
 
     if ( buffer.isEmpty() ) {
@@ -111,38 +108,48 @@ ssize_t Swipl_IO::_read_(char *buf, size_t bufsize) {
 
     for ( ; ; ) {
 
+        QString todo;
+
         {   QMutexLocker lk(&sync);
 
+            if (query.isEmpty() && buffer.isEmpty() && target && target->status != ConsoleEdit::eof)
+                input_ready.wait(&sync, SwiPrologEngine::signals_poll_ms);
+
             if (!query.isEmpty()) {
-                try {
-                    int rc = PlCall(query.toStdWString().data());
-                    qDebug() << "PlCall" << query << rc;
-                }
-                catch(PlException e) {
-                    qDebug() << t2w(e);
-                }
+                todo = query;
                 query.clear();
             }
+            else {
+                uint n = buffer.length();
+                Q_ASSERT(bufsize >= n);
+                if (n > 0) {
+                    uint l = bufsize < n ? bufsize : n;
+                    memcpy(buf, buffer, l);
+                    buffer.remove(0, l);
+                    return l;
+                }
 
-            uint n = buffer.length();
-            Q_ASSERT(bufsize >= n);
-            if (n > 0) {
-                uint l = bufsize < n ? bufsize : n;
-                memcpy(buf, buffer, l);
-                buffer.remove(0, l);
-                return l;
+                if (!target || target->status == ConsoleEdit::eof) {
+                    if (target)
+                        target->status = ConsoleEdit::running;
+                    return 0;
+                }
             }
+        }
 
-            if (target->status == ConsoleEdit::eof) {
-	        target->status = ConsoleEdit::running;
-                return 0;
-	    }
+        // don't hold the lock while running Prolog code
+        if (!todo.isEmpty()) {
+            try {
+                int rc = PlCall(todo.toStdWString().data());
+                qDebug() << "PlCall" << todo << rc;
+            }
+            catch(PlException e) {
+                qDebug() << t2w(e);
+            }
         }
 
 	if ( PL_handle_signals() < 0 )
 	    return -1;
-
-        SwiPrologEngine::msleep(10);
     }
 }
 
@@ -151,11 +158,18 @@ ssize_t Swipl_IO::_read_(char *buf, size_t bufsize) {
 void Swipl_IO::user_input(QString s) {
     QMutexLocker lk(&sync);
     buffer = s.toUtf8();
+    input_ready.wakeAll();
 }
 
 void Swipl_IO::take_input(QString cmd) {
     QMutexLocker lk(&sync);
     buffer = cmd.toUtf8();
+    input_ready.wakeAll();
+}
+
+void Swipl_IO::wake_reader() {
+    QMutexLocker lk(&sync);
+    input_ready.wakeAll();
 }
 
 void Swipl_IO::eng_at_exit(void *p) {
@@ -167,10 +181,12 @@ void Swipl_IO::attached(ConsoleEdit *c) {
     QMutexLocker lk(&sync);
     Q_ASSERT(target == 0);
     target = c;
+    input_ready.wakeAll();
 }
 
 void Swipl_IO::query_run(QString newquery) {
     QMutexLocker lk(&sync);
     Q_ASSERT(query.isEmpty());
     query = newquery;
+    input_ready.wakeAll();
 }
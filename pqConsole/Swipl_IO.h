@@ -52,11 +52,17 @@ public:
 
     void query_run(QString query);
 
+    /** let the reader serve a signal just raised (see PL_thread_raise) */
+    void wake_reader();
+
 private:
 
     /** syncronize inter thread access to buffer and query */
     QMutex sync;
 
+    /** signaled when buffer, query or target change */
+    QWaitCondition input_ready;
+
     /** output text buffer, made UTF8 */
     QByteArray buffer;
 
@@ -71,9 +77,6 @@ private:
 
 signals:
 
-    /** issued to queue a string to user output */
-    void user_output(QString output);
-
     /** issued to peek input - til to CR - from user */
     void user_prompt(int threadId, bool tty);
 
@@ -234,6 +234,13 @@ PREDICATE0(interrupt) {
  *  pq - updateRefreshRate(N) default 100
  *     - allow to alter default refresh rate (simply count outputs before setting cursor at end)
  *
+ *  pq - outputHighWater(N) default 262144
+ *     - pending output bytes before the writing thread waits the console to catch up
+ *
+ *  pq - scrollbackLines(N) default 20000
+ *     - remove (from top, in bulk) text lines when exceeding the limit
+ *       evicted lines are kept on disk when console_spill_history is set in preferences
+ *
  *  Qt - maximumBlockCount(N) default 0
  *     - remove (from top) text lines when exceeding the limit
  *
@@ -259,6 +266,55 @@ PREDICATE(console_settings, 1) {
     return FALSE;
 }
 
+/** console_scrollback_search(+Pattern, -Lines)
+ *  search (by regular expression) lines evicted from thread associated console
+ */
+PREDICATE(console_scrollback_search, 2) {
+    ConsoleEdit* c = pqConsole::by_thread();
+    if (c) {
+        QString Pattern = t2w(PL_A1);
+        QStringList Lines;
+
+        ConsoleEdit::exec_sync s;
+        c->exec_func([&]() {
+            Lines = c->scrollback_search(Pattern);
+            s.go();
+        });
+        s.stop();
+
+        PlTail lines(PL_A2);
+        foreach(QString x, Lines)
+            lines.append(W(x));
+        lines.close();
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/** message_source_benchmark(+Lines, -ScanMs, -LinkMs)
+ *  time the compiler messages scanner over Lines warning lines (try 100000),
+ *  then linking the same lines in a scratch document, on GUI thread
+ */
+PREDICATE(message_source_benchmark, 3) {
+    ConsoleEdit* c = pqConsole::by_thread();
+    if (c) {
+        int Lines = PL_A1;
+        qint64 scan_ms, link_ms;
+
+        ConsoleEdit::exec_sync s;
+        c->exec_func([&]() {
+            c->message_source_timing(Lines, scan_ms, link_ms);
+            s.go();
+        });
+        s.stop();
+
+        PL_A2 = long(scan_ms);
+        PL_A3 = long(link_ms);
+        return TRUE;
+    }
+    return FALSE;
+}
+
 /** getOpenFileName(+Title, ?StartPath, +Pattern, -Choice)
  *  run a modal dialog on request from foreign thread
  *  this must run a modal loop in GUI thread
@@ -351,6 +407,7 @@ PREDICATE0(select_ANSI_term_colors) {
             if (d.exec()) {
                 for (int i = 0; i < p.ANSI_sequences.size(); ++i)
                     p.ANSI_sequences[i] = d.customColor(i);
+                c->ansi_colors_changed();
                 c->repaint();
                 ok = true;
                 p.save();
@@ -42,6 +42,9 @@ SOURCES += \
     pqMainWindow.cpp \
     Preferences.cpp \
     FlushOutputEvents.cpp \
+    OutputRing.cpp \
+    ScrollbackLog.cpp \
+    AnsiParser.cpp \
     pqApplication.cpp \
     win_builtins.cpp \
     pqMiniSyntax.cpp \
@@ -62,6 +65,9 @@ HEADERS += \
     pqMainWindow.h \
     Preferences.h \
     FlushOutputEvents.h \
+    OutputRing.h \
+    ScrollbackLog.h \
+    AnsiParser.h \
     pqApplication.h \
     pqMiniSyntax.h \
     pqMeta.h \
@@ -0,0 +1,369 @@
+/*
+    pqGraphviz    : interfacing SWI-Prolog and Graphviz library
+
+    Author        : Carlo Capelli
+    E-mail        : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "pqGraphAnalytics.h"
+#include <queue>
+#include <limits>
+#include <functional>
+
+/** scan graph once, to get arrays indexed by node number
+ */
+pqGraphAdjacency::pqGraphAdjacency(Agraph_t *g, bool with_in_arcs) : graph(g)
+{
+    int n = agnnodes(g);
+    nodes.reserve(n);
+    ids.reserve(n);
+    for (Np v = agfstnode(g); v; v = agnxtnode(g, v)) {
+        ids.insert(v, nodes.size());
+        nodes.append(v);
+    }
+
+    bool directed = agisdirected(g);
+
+    out_off.reserve(n + 1);
+    out_adj.reserve(agnedges(g) * (directed ? 1 : 2));
+    out_edge.reserve(out_adj.capacity());
+    for (int i = 0; i < n; ++i) {
+        out_off.append(out_adj.size());
+        for (Ep e = agfstout(g, nodes[i]); e; e = agnxtout(g, e)) {
+            out_adj.append(ids.value(aghead(e)));
+            out_edge.append(e);
+        }
+        if (!directed)
+            for (Ep e = agfstin(g, nodes[i]); e; e = agnxtin(g, e)) {
+                out_adj.append(ids.value(agtail(e)));
+                out_edge.append(e);
+            }
+    }
+    out_off.append(out_adj.size());
+
+    if (with_in_arcs) {
+        // counting sort of arcs by target
+        in_off.fill(0, n + 1);
+        foreach (int t, out_adj)
+            ++in_off[t + 1];
+        for (int i = 0; i < n; ++i)
+            in_off[i + 1] += in_off[i];
+        in_adj.resize(out_adj.size());
+        QVector<int> fill = in_off;
+        for (int s = 0; s < n; ++s)
+            for (int a = out_off[s]; a < out_off[s + 1]; ++a)
+                in_adj[fill[out_adj[a]]++] = s;
+    }
+}
+
+/** native algorithms on graph structure, results returned in a single call
+ */
+
+#undef PROLOG_MODULE
+#define PROLOG_MODULE "pqGraphviz"
+#include "PREDICATE.h"
+
+typedef pqGraphAdjacency::Np Np;
+
+static Agraph_t *graph(T X) {
+    if (Agraph_t *p = pq_cast<Agraph_t>(X)) return p;
+    throw PlException("null ptr Agraph_t");
+}
+
+/** accept a node pointer or a list of node pointers
+ */
+static QVector<int> node_indexes(const pqGraphAdjacency &adj, T X) {
+    QVector<int> r;
+    auto add = [&](T t) {
+        int i = adj.index(pq_cast<Agnode_t>(t));
+        if (i < 0)
+            throw PlException("node not in graph");
+        r.append(i);
+    };
+    if (PL_is_list(X)) {
+        PlTail l(X);
+        PlTerm t;
+        while (l.next(t))
+            add(t);
+    }
+    else
+        add(X);
+    return r;
+}
+
+/** exactly one node: a list must not be empty or ambiguous
+ */
+static int node_index(const pqGraphAdjacency &adj, T X) {
+    QVector<int> r = node_indexes(adj, X);
+    if (r.size() != 1)
+        throw PlException(A(QString("expected a single node, got %1").arg(t2w(X))));
+    return r[0];
+}
+
+/** unify <X> with list of nodes
+ */
+static int unify_nodes(T X, const pqGraphAdjacency &adj, const QVector<int> &is) {
+    PlTail l(X);
+    foreach (int i, is)
+        l.append(PlTerm(VP(adj.nodes[i])));
+    return l.close();
+}
+
+/** gv_scc(+Graph, -Components)
+ *
+ *  strongly connected components (Tarjan), as list of lists of nodes
+ *  components are listed in reverse topological order
+ */
+PREDICATE(gv_scc, 2) {
+    pqGraphAdjacency adj(graph(PL_A1));
+    int n = adj.count();
+
+    QVector<int> index(n, -1), low(n);
+    QVector<char> on_stack(n, 0);
+    QVector<int> stack;
+    QVector<QVector<int>> comps;
+
+    struct frame { int v, arc; };
+    QVector<frame> calls;
+    int counter = 0;
+
+    for (int s = 0; s < n; ++s) {
+        if (index[s] >= 0)
+            continue;
+        calls.append(frame {s, adj.out_off[s]});
+        index[s] = low[s] = counter++;
+        stack.append(s);
+        on_stack[s] = 1;
+
+        while (!calls.isEmpty()) {
+            frame &f = calls.last();
+            int v = f.v;
+            if (f.arc < adj.out_off[v + 1]) {
+                int w = adj.out_adj[f.arc++];
+                if (index[w] < 0) {
+                    index[w] = low[w] = counter++;
+                    stack.append(w);
+                    on_stack[w] = 1;
+                    calls.append(frame {w, adj.out_off[w]});
+                }
+                else if (on_stack[w])
+                    low[v] = qMin(low[v], index[w]);
+            }
+            else {
+                calls.removeLast();
+                if (!calls.isEmpty()) {
+                    int u = calls.last().v;
+                    low[u] = qMin(low[u], low[v]);
+                }
+                if (low[v] == index[v]) {
+                    QVector<int> c;
+                    int w;
+                    do {
+                        w = stack.takeLast();
+                        on_stack[w] = 0;
+                        c.append(w);
+                    } while (w != v);
+                    comps.append(c);
+                }
+            }
+        }
+    }
+
+    PlTail l(PL_A2);
+    foreach (auto c, comps) {
+        PlTerm t;
+        unify_nodes(t, adj, c);
+        l.append(t);
+    }
+    return l.close();
+}
+
+/** gv_topological_order(+Graph, -Nodes)
+ *
+ *  nodes ordered so that each edge goes forward (Kahn), fails on cycles
+ */
+PREDICATE(gv_topological_order, 2) {
+    pqGraphAdjacency adj(graph(PL_A1), true);
+    int n = adj.count();
+
+    QVector<int> pending(n), order;
+    order.reserve(n);
+    for (int i = 0; i < n; ++i)
+        if ((pending[i] = adj.in_degree(i)) == 0)
+            order.append(i);
+
+    for (int q = 0; q < order.size(); ++q) {
+        int v = order[q];
+        for (int a = adj.out_off[v]; a < adj.out_off[v + 1]; ++a)
+            if (--pending[adj.out_adj[a]] == 0)
+                order.append(adj.out_adj[a]);
+    }
+
+    if (order.size() < n)
+        return FALSE;
+    return unify_nodes(PL_A2, adj, order);
+}
+
+/** gv_reachable(+Graph, +From, -Nodes)
+ *
+ *  closure of nodes reachable from From (a node or a list of nodes), From included
+ */
+PREDICATE(gv_reachable, 3) {
+    pqGraphAdjacency adj(graph(PL_A1));
+
+    QVector<char> seen(adj.count(), 0);
+    QVector<int> visit;
+    foreach (int s, node_indexes(adj, PL_A2))
+        if (!seen[s]) {
+            seen[s] = 1;
+            visit.append(s);
+        }
+
+    for (int q = 0; q < visit.size(); ++q) {
+        int v = visit[q];
+        for (int a = adj.out_off[v]; a < adj.out_off[v + 1]; ++a) {
+            int w = adj.out_adj[a];
+            if (!seen[w]) {
+                seen[w] = 1;
+                visit.append(w);
+            }
+        }
+    }
+
+    return unify_nodes(PL_A3, adj, visit);
+}
+
+/** gv_shortest_path(+Graph, +From, +To, -Path)
+ *
+ *  fewest edges path (breadth first), as list of nodes from From to To
+ *  fails if To is not reachable, raises an error unless From and To are single nodes of Graph
+ */
+PREDICATE(gv_shortest_path, 4) {
+    pqGraphAdjacency adj(graph(PL_A1));
+
+    int s = node_index(adj, PL_A2), t = node_index(adj, PL_A3);
+    QVector<int> pred(adj.count(), -1);
+    pred[s] = s;
+
+    QVector<int> visit;
+    visit.append(s);
+    for (int q = 0; q < visit.size() && pred[t] < 0; ++q) {
+        int v = visit[q];
+        for (int a = adj.out_off[v]; a < adj.out_off[v + 1]; ++a) {
+            int w = adj.out_adj[a];
+            if (pred[w] < 0) {
+                pred[w] = v;
+                visit.append(w);
+            }
+        }
+    }
+    if (pred[t] < 0)
+        return FALSE;
+
+    QVector<int> path;
+    for (int v = t; v != s; v = pred[v])
+        path.prepend(v);
+    path.prepend(s);
+    return unify_nodes(PL_A4, adj, path);
+}
+
+/** gv_shortest_path(+Graph, +From, +To, +WeightAttr, -Path, -Cost)
+ *
+ *  least cost path (Dijkstra), weights from numeric edge attribute WeightAttr
+ *  (missing or empty values count 1, negative are errors)
+ */
+PREDICATE(gv_shortest_path, 6) {
+    Agraph_t *g = graph(PL_A1);
+    pqGraphAdjacency adj(g);
+
+    Agsym_t *w_sym = agattr(agroot(g), AGEDGE, CP(PL_A4), 0);
+    if (!w_sym)
+        throw PlException(A(QString("undeclared edge attribute %1").arg(t2w(PL_A4))));
+
+    // weights read once, in arcs order
+    QVector<double> weight(adj.out_edge.size(), 1);
+    for (int a = 0; a < weight.size(); ++a) {
+        bool ok;
+        double v = QString::fromUtf8(agxget(adj.out_edge[a], w_sym)).toDouble(&ok);
+        if (ok) {
+            if (v < 0)
+                throw PlException("negative edge weight");
+            weight[a] = v;
+        }
+    }
+
+    int s = node_index(adj, PL_A2), t = node_index(adj, PL_A3);
+    const double inf = std::numeric_limits<double>::infinity();
+    QVector<double> dist(adj.count(), inf);
+    QVector<int> pred(adj.count(), -1);
+
+    typedef std::pair<double, int> qe;
+    std::priority_queue<qe, std::vector<qe>, std::greater<qe>> q;
+    dist[s] = 0;
+    q.push(qe(0, s));
+    while (!q.empty()) {
+        qe top = q.top();
+        q.pop();
+        int v = top.second;
+        if (top.first > dist[v])
+            continue;
+        if (v == t)
+            break;
+        for (int a = adj.out_off[v]; a < adj.out_off[v + 1]; ++a) {
+            int w = adj.out_adj[a];
+            double d = dist[v] + weight[a];
+            if (d < dist[w]) {
+                dist[w] = d;
+                pred[w] = v;
+                q.push(qe(d, w));
+            }
+        }
+    }
+    if (dist[t] == inf)
+        return FALSE;
+
+    QVector<int> path;
+    for (int v = t; v != s; v = pred[v])
+        path.prepend(v);
+    path.prepend(s);
+    return unify_nodes(PL_A5, adj, path) && (PL_A6 = dist[t]);
+}
+
+/** gv_degrees(+Graph, -Degrees, -Stats)
+ *
+ *  Degrees is a list of Node-In-Out
+ *  Stats is degree_stats(Nodes, Arcs, MaxIn, MaxOut, MeanOut)
+ */
+PREDICATE(gv_degrees, 3) {
+    pqGraphAdjacency adj(graph(PL_A1), true);
+    int n = adj.count(), max_in = 0, max_out = 0;
+
+    PlTail l(PL_A2);
+    for (int i = 0; i < n; ++i) {
+        int in = adj.in_degree(i), out = adj.out_degree(i);
+        max_in = qMax(max_in, in);
+        max_out = qMax(max_out, out);
+        l.append(PlCompound("-", V(PlCompound("-", V(PlTerm(VP(adj.nodes[i])), PlTerm(long(in)))), PlTerm(long(out)))));
+    }
+    if (!l.close())
+        return FALSE;
+
+    int arcs = adj.out_adj.size();
+    double mean = n ? double(arcs) / n : 0;
+    return PL_A3 = PlCompound("degree_stats", V(long(n), long(arcs), long(max_in), long(max_out), mean));
+}
@@ -0,0 +1,62 @@
+/*
+    pqGraphviz    : interfacing SWI-Prolog and Graphviz library
+
+    Author        : Carlo Capelli
+    E-mail        : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef PQGRAPHANALYTICS_H
+#define PQGRAPHANALYTICS_H
+
+#include "pqGraphviz_global.h"
+#include <graphviz/cgraph.h>
+#include <QVector>
+#include <QHash>
+
+/** compact snapshot of graph structure, for algorithms visiting it repeatedly
+ *  nodes are numbered in agfstnode/agnxtnode order, arcs stored in contiguous arrays
+ *  undirected graphs get both directions
+ */
+struct PQGRAPHVIZSHARED_EXPORT pqGraphAdjacency {
+
+    typedef Agnode_t* Np;
+    typedef Agedge_t* Ep;
+
+    pqGraphAdjacency(Agraph_t *g, bool with_in_arcs = false);
+
+    Agraph_t *graph;
+
+    int count() const { return nodes.size(); }
+    int index(Np n) const { return ids.value(n, -1); }
+
+    //! node of index i
+    QVector<Np> nodes;
+    QHash<Np, int> ids;
+
+    //! arcs leaving i are [out_off[i], out_off[i+1]), to out_adj[], via out_edge[]
+    QVector<int> out_off, out_adj;
+    QVector<Ep> out_edge;
+
+    //! ditto entering, if requested
+    QVector<int> in_off, in_adj;
+
+    int out_degree(int i) const { return out_off[i + 1] - out_off[i]; }
+    int in_degree(int i) const { return in_off[i + 1] - in_off[i]; }
+};
+
+#endif // PQGRAPHANALYTICS_H
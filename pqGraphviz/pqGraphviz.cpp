@@ -24,6 +24,7 @@
 #include "lqXDot.h"
 #include <QDebug>
 #include <QMessageBox>
+#include <QHash>
 
 #include "SwiPrologEngine.h"
 
@@ -302,6 +303,99 @@ PREDICATE(agsafeset, 4) {
     return TRUE;
 }
 
+/** attribute symbols resolved once for a bulk construction call
+ *  K=V requires K declared (as agset), K:V declares K with default V (as agsafeset)
+ */
+struct bulk_attrs {
+    bulk_attrs(Agraph_t *g) : root(agroot(g)) {}
+
+    void set(VP obj, int kind, T attrs) {
+        PlTail l(attrs);
+        PlTerm a;
+        while (l.next(a)) {
+            if (a.arity() != 2)
+                throw PlException(A(QString("invalid attribute %1").arg(serialize(a))));
+            bool safe = !strcmp(a.name(), ":");
+            if (!safe && strcmp(a.name(), "="))
+                throw PlException(A(QString("invalid attribute %1").arg(serialize(a))));
+
+            QByteArray name = CP(a[1]);
+            CP value = decoattr("bulk_attrs", obj, a[2]);
+
+            Agsym_t *&sym = syms[kind][name];
+            if (!sym && !(sym = agattr(root, kind, name.data(), 0))) {
+                if (!safe)
+                    throw PlException(A(QString("undeclared attribute %1").arg(QString(name))));
+                sym = agattr(root, kind, name.data(), value);
+            }
+            if (agxset(obj, sym, value))
+                throw PlException(A(QString("agxset %1 failed").arg(QString(name))));
+        }
+    }
+
+private:
+    Agraph_t *root;
+    QHash<QByteArray, Agsym_t*> syms[AGINEDGE + 1];
+};
+
+/** gv_make_nodes(+Graph, +Specs, -Nodes)
+ *
+ *  create (or find) all nodes in one call
+ *  each spec is Name or Name-Attrs, Attrs a list of K=V or K:V (as set_attrs/2)
+ *  Nodes are pointers in Specs order
+ */
+PREDICATE(gv_make_nodes, 3) {
+    Agraph_t *G = graph(PL_A1);
+    bulk_attrs attrs(G);
+
+    PlTail specs(PL_A2), nodes(PL_A3);
+    PlTerm spec;
+    while (specs.next(spec)) {
+        bool with_attrs = spec.type() == PL_TERM && spec.arity() == 2 && !strcmp(spec.name(), "-");
+        Agnode_t *N = agnode(G, CP(with_attrs ? spec[1] : spec), 1);
+        if (!N)
+            throw PlException(A(QString("agnode %1 failed").arg(serialize(spec))));
+        if (with_attrs)
+            attrs.set(N, AGNODE, spec[2]);
+        nodes.append(PlTerm(VP(N)));
+    }
+    return nodes.close();
+}
+
+/** gv_make_edges(+Graph, +Specs, -Edges)
+ *
+ *  create all edges in one call, nodes are found or created by name
+ *  each spec is From-To, edge(From,To), edge(From,To,Attrs) or edge(From,To,Name,Attrs)
+ *  Edges are pointers in Specs order
+ */
+PREDICATE(gv_make_edges, 3) {
+    Agraph_t *G = graph(PL_A1);
+    bulk_attrs attrs(G);
+
+    PlTail specs(PL_A2), edges(PL_A3);
+    PlTerm spec;
+    while (specs.next(spec)) {
+        int arity = spec.type() == PL_TERM ? spec.arity() : 0;
+        bool arrow = arity == 2 && !strcmp(spec.name(), "-");
+        if (!arrow && !(arity >= 2 && arity <= 4 && !strcmp(spec.name(), "edge")))
+            throw PlException(A(QString("invalid edge %1").arg(serialize(spec))));
+
+        Agnode_t *t = agnode(G, CP(spec[1]), 1);
+        Agnode_t *h = agnode(G, CP(spec[2]), 1);
+        if (!t || !h)
+            throw PlException(A(QString("agnode failed on %1").arg(serialize(spec))));
+
+        Agedge_t *E = agedge(G, t, h, arity == 4 ? CP(spec[3]) : CP(""), 1);
+        if (!E)
+            throw PlException(A(QString("agedge failed on %1").arg(serialize(spec))));
+        if (arity >= 3)
+            attrs.set(E, AGEDGE, spec[arity]);
+
+        edges.append(PlTerm(VP(E)));
+    }
+    return edges.close();
+}
+
 /** Agnode_t *agfstnode(Agraph_t * g);
  *
  *  - Agraph.pdf
@@ -31,12 +31,14 @@ DEFINES += PQGRAPHVIZ_LIBRARY
 
 SOURCES += \
     pqGraphviz.cpp \
-    pqDocView.cpp
+    pqDocView.cpp \
+    pqGraphAnalytics.cpp
 
 HEADERS += \
     pqGraphviz.h \
     pqGraphviz_global.h \
-    pqDocView.h
+    pqDocView.h \
+    pqGraphAnalytics.h
 
 OTHER_FILES += \
     prolog/gv_uty.pl \
@@ -49,7 +51,8 @@ OTHER_FILES += \
     prolog/termtree.pl \
     test/genealogy/familiari.pdf \
     test/genealogy/pqGraphviz_emu.pl \
-    test/genealogy/allocator.pl
+    test/genealogy/allocator.pl \
+    test/bulk/bulk_build.pl
 
 unix {
     target.path = /usr/lib
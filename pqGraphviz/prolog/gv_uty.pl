@@ -43,6 +43,7 @@
 	,make_cluster/4
 	,find_cluster/3
 	,set_attrs/2
+	,make_graph/3
 	]).
 
 :-  use_module(library(option)).
@@ -293,6 +294,17 @@ set_attrs(O, As) :-
                 ;       As=K:V ->
                         pqGraphviz:agsafeset(O, K, V, V)).
 
+%%  make_graph(+Graph, +Nodes:list, +Edges:list) is det
+%
+%   bulk construction, each list in a single foreign call
+%   Nodes elements are Name or Name-Attrs
+%   Edges elements are From-To, edge(From,To), edge(From,To,Attrs) or edge(From,To,Name,Attrs)
+%   Attrs as in set_attrs/2, attribute symbols are resolved once
+%
+make_graph(G, Nodes, Edges) :-
+        pqGraphviz:gv_make_nodes(G, Nodes, _),
+        pqGraphviz:gv_make_edges(G, Edges, _).
+
 %%  use_node_attrs(+G, +Defaults)
 %
 %   defaulting nodes attributes required to call agset
@@ -0,0 +1,62 @@
+/** <module> bulk_build
+ *	compare graph construction: per object foreign calls vs bulk predicates
+ *
+ *  run from pqConsole, with pqGraphviz loaded:
+ *  ?- bulk_build(200000).
+ *
+ *  @license LGPL 2.1
+ */
+
+:- module(bulk_build,
+	[bulk_build/1
+	,bulk_build/2
+	]).
+
+:- if(\+current_module(gv_uty)).
+:- use_module('../../prolog/gv_uty').
+:- endif.
+
+%%	bulk_build(+NumEdges) is det.
+%
+%	random graph with NumEdges edges on NumEdges/4 nodes
+%
+bulk_build(NumEdges) :-
+	NumNodes is max(1, NumEdges // 4),
+	bulk_build(NumNodes, NumEdges).
+
+%%	bulk_build(+NumNodes, +NumEdges) is det.
+%
+%	build same graph both ways, print timings
+%
+bulk_build(NumNodes, NumEdges) :-
+	findall(N-[label:N, shape:box], between(1, NumNodes, N), Nodes),
+	findall(edge(F, T, [color:blue]),
+		(   between(1, NumEdges, _),
+		    random_between(1, NumNodes, F),
+		    random_between(1, NumNodes, T)
+		), Edges),
+	timed(per_object, build_per_object(Nodes, Edges)),
+	timed(bulk, build_bulk(Nodes, Edges)).
+
+timed(Label, Goal) :-
+	pqGraphviz:agopen(Label, 'Agdirected', 0, G),
+	statistics(cputime, T0),
+	call(Goal, G),
+	statistics(cputime, T1),
+	pqGraphviz:agnnodes(G, NN),
+	pqGraphviz:agnedges(G, NE),
+	pqGraphviz:agclose(G),
+	T is T1 - T0,
+	format('~w: ~d nodes ~d edges ~3f sec~n', [Label, NN, NE, T]).
+
+build_per_object(Nodes, Edges, G) :-
+	forall(member(N-As, Nodes), make_node(G, N, As, _)),
+	forall(member(edge(F, T, As), Edges),
+	       (   find_node(G, F, Fp),
+		   find_node(G, T, Tp),
+		   new_edge(G, Fp, Tp, E),
+		   set_attrs(E, As)
+	       )).
+
+build_bulk(Nodes, Edges, G) :-
+	make_graph(G, Nodes, Edges).
@@ -26,15 +26,22 @@
 
 #include <QDebug>
 #include <QStack>
+#include <climits>
 
 pqHighlighter::pqHighlighter(QTextEdit *host) :
     pqMiniSyntax(host),
-    status(idle)
+    status(idle),
+    scanned(0),
+    scan_nest_ms(0),
+    scan_count(0)
 {
 }
 pqHighlighter::pqHighlighter(QPlainTextEdit *host) :
     pqMiniSyntax(host),
-    status(idle)
+    status(idle),
+    scanned(0),
+    scan_nest_ms(0),
+    scan_count(0)
 {
 }
 
@@ -54,36 +61,49 @@ void pqHighlighter::highlightBlock(const QString &text)
         return;
     }
 
-    if (status == completed) {
-        QTextBlock b = currentBlock();
-        set_sem_attrs(b.position(), b.position() + b.length(), cats);
-    }
+    QTextBlock b = currentBlock();
+    if (status == completed || b.position() + b.length() <= scanned)
+        set_sem_attrs(b.position(), b.position() + b.length());
     else
         pqMiniSyntax::highlightBlock(text);
 }
 
-void pqHighlighter::set_sem_attrs(int p, int c, const t_nesting &nest)
+/** top level areas overlapping the block, each in its own frame
+ */
+void pqHighlighter::set_sem_attrs(int p, int c)
 {
-    foreach(const cat& x, nest) {
-        // f,q cat coords
-        int f = x.beg;
-        int q = x.end;
-        if (c > f && p < q) {
-            // offset in block
-            int b = std::max(f, p);
-            int e = std::min(q, c);
-
-            if (x.fmt.isValid())
-                setFormat(b - p, e - b, x.fmt);
-
-            set_sem_attrs(p, c, x.nesting);
-        }
+    int i = top_lower_bound(p);
+    if (i > 0 && top(i - 1).end > p)
+        --i;
+    for ( ; i < cats.size(); ++i) {
+        int s = shift(i);
+        if (cats[i].beg + s >= c)
+            break;
+        set_sem_attrs(p - s, c - s, cats[i]);
+    }
+}
+
+void pqHighlighter::set_sem_attrs(int p, int c, const cat &x)
+{
+    // f,q cat coords
+    int f = x.beg;
+    int q = x.end;
+    if (c > f && p < q) {
+        // offset in block
+        int b = std::max(f, p);
+        int e = std::min(q, c);
+
+        if (x.fmt.isValid())
+            setFormat(b - p, e - b, x.fmt);
+
+        foreach(const cat& y, x.nesting)
+            set_sem_attrs(p, c, y);
     }
 }
 
 void pqHighlighter::highlightBlock(const QTextBlock &b)
 {
-    set_sem_attrs(b.position(), b.position() + b.length(), cats);
+    set_sem_attrs(b.position(), b.position() + b.length());
 }
 
 void pqHighlighter::rehighlightLines(ParenMatching::range mr)
@@ -104,18 +124,22 @@ void pqHighlighter::rehighlightLines(ParenMatching::range mr)
  */
 void pqHighlighter::cursorPositionChanged(QTextCursor c)
 {
-    // scan top level
-    const t_nesting *scan = &cats;
+    // top level by bisection, then scan its nesting in its frame
     const cat *inner = 0;
+    int t = top_at(c.position()), s = t >= 0 ? shift(t) : 0;
 
     QStack<const cat*> stcat;
-    l:foreach(const cat& x, *scan) {
-        if (x.contains(c.position())) {
-            inner = &x;
-            scan = &x.nesting;
-            if (stcat.isEmpty())
-                stcat.push(&x);
-            goto l;
+    if (t >= 0) {
+        inner = &cats[t];
+        stcat.push(inner);
+        const t_nesting *scan = &inner->nesting;
+        int p = c.position() - s;
+        l:foreach(const cat& x, *scan) {
+            if (x.contains(p)) {
+                inner = &x;
+                scan = &x.nesting;
+                goto l;
+            }
         }
     }
 
@@ -125,20 +149,20 @@ void pqHighlighter::cursorPositionChanged(QTextCursor c)
     clear_highlighting();
 
     if (inner && inner->desc == "var") {
-        if (!hvars.contains(inner)) {
+        if (!hvars.contains(moved(*inner, s))) {
 
             clear_hvars();
 
-            QString sym = text(inner);
+            QString sym = text(moved(*inner, s));
             while (!stcat.isEmpty()) {
                 const cat* t = stcat.pop();
-                if (t->desc == "var" && text(t) == sym)
-                    hvars.append(t);
+                if (t->desc == "var" && text(moved(*t, s)) == sym)
+                    hvars.append(moved(*t, s));
                 foreach(const cat& x, t->nesting)
                     stcat.push(&x);
             }
 
-            foreach(const cat* x, hvars)
+            foreach(range x, hvars)
                 underline(x, true);
         }
         return;
@@ -160,23 +184,23 @@ QTextCursor pqHighlighter::area(range r) const
 
 /** get text of categorized area
  */
-QString pqHighlighter::text(const cat* c) const { return area(c).selectedText(); }
+QString pqHighlighter::text(range r) const { return area(r).selectedText(); }
 
 /** change underline of categorized area
  *  this requires signals NOT disabled in document
  */
-void pqHighlighter::underline(const cat* c, bool u)
+void pqHighlighter::underline(range r, bool u)
 {
     QTextCharFormat f;
     f.setFontUnderline(u);
-    area(c).setCharFormat(f);
+    area(r).setCharFormat(f);
 }
 
 /** factorize out debugging variables highlighting
  */
 void pqHighlighter::clear_hvars()
 {
-    foreach(const cat* x, hvars)
+    foreach(range x, hvars)
         underline(x, false);
     hvars.clear();
 }
@@ -199,12 +223,123 @@ void pqHighlighter::test_highlighting(QTextCursor c)
 void pqHighlighter::scan_start()
 {
     cats.clear();
+    shifts.clear();
     status = scanning;
+    scanned = 0;
+    scan_edits.clear();
+    pending.clear();
+    scan_timer.start();
+    scan_nest_ms = 0;
+    scan_count = 0;
+}
+
+/** fragments positions are from file: apply edits done meanwhile
+ */
+void pqHighlighter::scan_fragments(const pqSyntaxStream::fragments &l, int upto)
+{
+    auto edited = [this](int p) {
+        foreach(auto e, scan_edits)
+            if (p >= e.first)
+                p = qMax(e.first, p + e.second);
+        return p;
+    };
+
+    QElapsedTimer tm;
+    tm.start();
+
+    if (scan_edits.isEmpty())
+        add_elements(l);
+    else {
+        pqSyntaxStream::fragments m = l;
+        for (int i = 0; i < m.size(); ++i) {
+            int b = edited(m[i].from), e = edited(m[i].from + m[i].len);
+            m[i].from = b;
+            m[i].len = e - b;
+        }
+        sort_elements(m);
+        add_elements(m);
+    }
+    scan_nest_ms += tm.elapsed();
+    scan_count += l.size();
+
+    // last batch is flagged with INT_MAX: all text is covered
+    if (upto == INT_MAX)
+        upto = document()->characterCount();
+    else
+        upto = qMin(edited(upto), document()->characterCount());
+    if (upto > scanned) {
+        pending << range(scanned, upto);
+        scanned = upto;
+    }
+}
+
+void pqHighlighter::scan_edit(int position, int charsRemoved, int charsAdded)
+{
+    int delta = charsAdded - charsRemoved;
+    if (delta == 0)
+        return;
+    scan_edits << qMakePair(position, delta);
+    contentsChange(position, charsRemoved, charsAdded);
+
+    if (scanned > position)
+        scanned = qMax(position, scanned + delta);
+    for (int i = 0; i < pending.size(); ++i) {
+        range &p = pending[i];
+        if (p.beg > position)
+            p.beg = qMax(position, p.beg + delta);
+        if (p.end > position)
+            p.end = qMax(position, p.end + delta);
+    }
+}
+
+/** rehighlight blocks in <r>, up to max_blocks, return blocks done
+ */
+int pqHighlighter::rehighlight_range(range r, int max_blocks)
+{
+    int done = 0;
+    for (QTextBlock b = document()->findBlock(r.beg); b.isValid() && b.position() < r.end && done < max_blocks; b = b.next(), ++done)
+        rehighlightBlock(b);
+    return done;
+}
+
+/** pending areas are split around the visible one
+ */
+bool pqHighlighter::rehighlight_pending(range visible, int max_blocks)
+{
+    QList<range> left;
+    foreach(auto p, pending) {
+        int b = qMax(p.beg, visible.beg), e = qMin(p.end, visible.end);
+        if (b < e) {
+            rehighlight_range(range(b, e), INT_MAX);
+            if (p.beg < b)
+                left << range(p.beg, b);
+            if (e < p.end)
+                left << range(e, p.end);
+        }
+        else if (p.size() > 0)
+            left << p;
+    }
+
+    pending.clear();
+    foreach(auto p, left) {
+        int n = max_blocks > 0 ? rehighlight_range(p, max_blocks) : 0;
+        max_blocks -= n;
+        if (n > 0) {
+            QTextBlock b = document()->findBlock(p.beg);
+            for (int i = 0; i < n && b.isValid(); ++i)
+                b = b.next();
+            p.beg = b.isValid() ? b.position() : p.end;
+        }
+        if (p.size() > 0)
+            pending << p;
+    }
+    return !pending.isEmpty();
 }
 
 void pqHighlighter::scan_done()
 {
     status = completed;
+    qDebug() << "scan_fragments" << scan_count << "fragments in" << scan_timer.elapsed() << "nest" << scan_nest_ms;
 }
 
 /** top down 'breadcrumbs' location of current cursor element
@@ -212,14 +347,10 @@ void pqHighlighter::scan_done()
 QStringList pqHighlighter::elementPath(QTextCursor c) const
 {
     QStringList l;
-    const t_nesting *n = &cats;
-    _:foreach(const cat& x, *n)
-        if (x.contains(c.position())) {
-            if (!x.desc.isEmpty())
-                l.append(x.desc);
-            n = &x.nesting;
-            goto _;
-        }
+    itcs pp = position_path(c.position());
+    foreach(itc x, pp)
+        if (!x->desc.isEmpty())
+            l.append(x->desc);
     return l;
 }
 
@@ -227,16 +358,9 @@ QStringList pqHighlighter::elementPath(QTextCursor c) const
  */
 QString pqHighlighter::elementEdit(QTextCursor c) const
 {
-    const t_nesting *n = &cats;
-    const cat *i = 0;
-    _:foreach(const cat& x, *n)
-        if (x.contains(c.position())) {
-            i = &x;
-            n = &x.nesting;
-            goto _;
-        }
-    if (i)
-        return text(i);
+    itcs pp = position_path(c.position());
+    if (!pp.isEmpty())
+        return text(moved(*pp.last(), shift(pp.first())));
     return QString();
 }
 
@@ -249,7 +373,7 @@ QString pqHighlighter::get_clause_at(int position) const
     range cb = clause_boundary(position);
     if (cb.size() > 0 && cb.end < cats.size()) {
         // get plain text
-        int start = cats[cb.beg].beg, stop = cats[cb.end].end;
+        int start = top(cb.beg).beg, stop = top(cb.end).end;
         x = range(start, stop).plainText(document());
     }
     return x;
@@ -269,7 +393,7 @@ QString pqHighlighter::get_predicate_indicator(QTextCursor c) const
             T V, E; L l(E); l.close();
             if (read_term_from_atom(A(pp[2]->desc), V, E))
                 if (V.arity() == 2)
-                    return QString("%1/%2").arg(text(pp[2])).arg(V[2].arity());
+                    return QString("%1/%2").arg(text(moved(*pp[2], shift(pp[0])))).arg(V[2].arity());
         }
         catch(PlException ex) {
             qDebug() << t2w(ex);
@@ -292,8 +416,10 @@ QStringList pqHighlighter::vars(QTextCursor p) const
 {
     QSet<QString> vs;
     itcs pp = position_path(p.position());
-    if (!pp.isEmpty())
-        topdown_preorder(*pp[0], [&](const cat &c) { if (c.desc == "var")  vs << text(&c); });
+    if (!pp.isEmpty()) {
+        int s = shift(pp[0]);
+        topdown_preorder(*pp[0], [&](const cat &c) { if (c.desc == "var")  vs << text(moved(c, s)); });
+    }
     return vs.toList();
 }
 
@@ -321,19 +447,20 @@ bool pqHighlighter::getPredicateHead(pqHighlighter::predicateHead &ph, QTextCurs
             qDebug() << t2w(ex);
         }
 
+        int s = shift(pp[0]);
         for (int c = 1; c < pp[0]->nesting.size(); ++c) {
             const cat &C = pp[0]->nesting[c];
             if (C.desc == "neck")
                 break;
             if (C.desc == "var") {
                 if (c - 1 < ph.vars.size())
-                    ph.vars[c - 1] = text(&C);
+                    ph.vars[c - 1] = text(moved(C, s));
                 else
-                    ph.vars << text(&C);
+                    ph.vars << text(moved(C, s));
             }
         }
 
-        p.setPosition(pp[0]->beg);
+        p.setPosition(pp[0]->beg + s);
         return true;
     }
     return false;
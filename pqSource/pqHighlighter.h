@@ -31,6 +31,7 @@
 #include <QMutexLocker>
 
 #include "pqSyntaxData.h"
+#include "pqSyntaxStream.h"
 #include "pqMiniSyntax.h"
 
 /** highlighter specialized to handle nested categories
@@ -63,6 +64,17 @@ public:
     void scan_done();
     bool sem_info_avail() const { return status == completed; }
 
+    //! while scanning: store a batch, analysis is complete up to <upto>
+    void scan_fragments(const pqSyntaxStream::fragments &l, int upto);
+
+    //! while scanning: text changed, shift positions of fragments yet to come
+    void scan_edit(int position, int charsRemoved, int charsAdded);
+    bool scanning_now() const { return status == scanning; }
+
+    //! rehighlight blocks with semantic info not yet applied:
+    //! first those in <visible>, then up to <max_blocks> others. Return true if more remain
+    bool rehighlight_pending(range visible, int max_blocks);
+
     //! editing helper - highlight variables on cursor position
     void cursorPositionChanged(QTextCursor c);
 
@@ -103,20 +115,20 @@ protected:
     virtual void highlightBlock(const QString &text);
 
     //! change attributes on range based on collected semantic analysis
-    void set_sem_attrs(int p, int c, const t_nesting &nest);
+    void set_sem_attrs(int p, int c);
+    void set_sem_attrs(int p, int c, const cat &x);
 
-    //! change underline of categorized area
-    void underline(const cat* c, bool u);
+    //! change underline of area
+    void underline(range r, bool u);
 
-    //! categorized area text cursor
-    QTextCursor area(const cat* c) const { return area(*c); }
+    //! area text cursor, actual positions
     QTextCursor area(range r) const;
 
     QTextCursor onech(int p) const { return area(range(p, p + 1)); }
     QTextCursor onech(QTextCursor p) const { return onech(p.position()); }
 
-    //! fetch categorized area text
-    QString text(const cat* c) const;
+    //! fetch area text, actual positions
+    QString text(range r) const;
 
     void pairchf(range r, QTextCharFormat f) {
         onech(r.beg).setCharFormat(f);
@@ -126,6 +138,21 @@ protected:
     //! remember highlighted match
     range paren;
 
+    //! while scanning, semantic info is available before this position
+    int scanned;
+
+    //! measures of the streamed scan: elapsed since scan_start, GUI time nesting batches, fragments
+    QElapsedTimer scan_timer;
+    qint64 scan_nest_ms;
+    int scan_count;
+
+    //! edits while scanning
+    QList<QPair<int, int>> scan_edits;
+
+    //! text areas with semantic info still to apply, sorted
+    QList<range> pending;
+    int rehighlight_range(range r, int max_blocks);
+
     //! FindReplace duty
     QTextCursor marker;
 
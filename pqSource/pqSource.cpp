@@ -39,7 +39,6 @@
 #include <QMessageBox>
 #include <QCloseEvent>
 #include <QtConcurrent>
-#include <QFutureWatcher>
 #include <QInputDialog>
 #include <QStringListModel>
 
@@ -51,15 +50,6 @@ predicate2(syncol)
 // from :/prolog/syncol.pl
 predicate4(recolor)
 
-// from :/prolog/syntax_colours.pl
-predicate2(syntax_colour)
-
-// from :/prolog/syncol.pl
-predicate2(syncol_allfile)
-
-// frag(term,int,int,list)
-structure4(frag)
-
 /**
  * @brief pqSource::pqSource
  *  constructor of an empty source document
@@ -71,6 +61,7 @@ structure4(frag)
 pqSource::pqSource(QString file) :
     state_curr(idle), state_next(idle),
     file(file),
+    recolor_revision(-1),
     debugStatus(no_Debug),
     debugCommand(no_Command),
     skip_changes(),
@@ -92,6 +83,15 @@ pqSource::pqSource(QString file) :
 
     hl = new pqHighlighter(this);
 
+    highlight_timer.setSingleShot(true);
+    highlight_timer.setInterval(0);
+    connect(&highlight_timer, SIGNAL(timeout()), SLOT(highlightPending()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), SLOT(highlightPending()));
+
+    recolor_timer.setSingleShot(true);
+    recolor_timer.setInterval(300);
+    connect(&recolor_timer, SIGNAL(timeout()), SLOT(recolorPending()));
+
     document()->documentLayout()->registerHandler(framed_handler->type(), framed_handler);
     document()->documentLayout()->registerHandler(folded_handler->type(), folded_handler);
 }
@@ -103,6 +103,8 @@ pqSource::pqSource(QString file) :
 pqSource::~pqSource()
 {
     qDebug() << "pqSource::~pqSource" << file;
+    if (stream)
+        stream->cancel();
     delete hl;
     delete framed_handler;
     delete folded_handler;
@@ -171,24 +173,10 @@ void pqSource::editInvoke()
 //
 PREDICATE(callback, 4)
 {
-    T Attributes;
-    if (syntax_colour(PL_A2, Attributes)) {
-        static pqTextAttributes ta;
-        static QMutex mtx;
-        QMutexLocker lk(&mtx);
-
-        QString kind;
-        switch (PL_A2.arity()) {
-        case 0:
-        case 1:
-            kind = t2w(PL_A2);
-            break;
-        case 2:
-        default:
-            kind = QString("%1(%2)").arg(PL_A2.name(), PL_A2[1].name());
-        }
-        pq_cast<pqSyntaxData>(PL_A1)->add_element_attr(kind, PL_A3, PL_A4, ta[Attributes]);
-    }
+    QString kind;
+    QTextCharFormat fmt;
+    if (pqTextAttributes::classify(PL_A2, kind, fmt))
+        pq_cast<pqSyntaxData>(PL_A1)->add_element_attr(kind, PL_A3, PL_A4, fmt);
     else
         pq_cast<pqSyntaxData>(PL_A1)->add_element(PL_A2.name(), PL_A3, PL_A4);
     return TRUE;
@@ -308,13 +296,8 @@ void pqSource::loadSource(int line, int linepos)
         reportUser(tr("not a Prolog file, reading as text"));
     else {
         int lc = document()->lineCount();
-        const int MAX_LINES = 10000;
-        if (lc < MAX_LINES) {
-            reportUser(tr("highlighting %1 lines").arg(lc));
-            startHighliter();
-        }
-        else
-            reportUser(tr("file too big to be highlighted (%1 lines, max. %2)").arg(thousandsDots(lc), thousandsDots(MAX_LINES)));
+        reportUser(tr("highlighting %1 lines").arg(thousandsDots(lc)));
+        startHighliter();
     }
 
     if (nl_conv)
@@ -350,52 +333,74 @@ void pqSource::placeCursor(int line, int linepos)
 }
 
 // start highlighting, using SWI-Prolog syntax analyzer to collect structured data
+// fragments are streamed from a background engine, and applied visible area first
 //
 void pqSource::startHighliter()
 {
-    // collect structure asyncronously
-    auto f = [](QString file, pqSyntaxData* psd) {
-        QElapsedTimer tm;
-        tm.start();
-        SwiPrologEngine::in_thread _it;
-        //qDebug() << file << "engine in " << tm.restart();
-
-        try {
-            T results, f;
-            int rc = syncol_allfile(A(file), results);
-            qDebug() << file << "syncol_allfile" << rc << "in" << tm.restart();
+    if (stream)
+        stream->cancel();
+
+    // the scan recolours everything: drop queued clauses, and results to come
+    recolor_pending.clear();
+    recolor_timer.stop();
+    if (recolor_running) {
+        recolor_running->disconnect(this);
+        recolor_running->deleteLater();
+        recolor_running = 0;
+    }
 
-            pqTextAttributes ta;
+    hl->scan_start();
 
-            for (L scanres(results); scanres.next(f); ) {
-                psd->add_element_sorted(t2w(f[3]), f[1], f[2], ta[f[4]]);
-            }
+    stream = new pqSyntaxStream(file);
+    connect(stream, SIGNAL(fragments_ready()), SLOT(streamFragments()));
+    connect(stream, SIGNAL(finished()), SLOT(runHighliter()));
+    connect(stream, SIGNAL(finished()), stream, SLOT(deleteLater()));
+    stream->start();
+}
 
-            //qDebug() << file << "done add_element_attr" << "in" << tm.elapsed();
-        }
-        catch(PlException e) {
-            //emit reportError(t2w(e));
-        }
-    };
-    hl->scan_start();
-//#define ASYNC_SYNCOL_HIGHLIGHT
-#ifdef ASYNC_SYNCOL_HIGHLIGHT
-    auto w = new QFutureWatcher<void>;
-    connect(w, SIGNAL(finished()), this, SLOT(runHighliter()));
+void pqSource::streamFragments()
+{
+    if (sender() != stream)
+        return;
 
-    // run the Prolog snippet in background (hl pointer)
-    w->setFuture(QtConcurrent::run(f, file, hl));
-#else
-    f(file, hl);
-    runHighliter();
-#endif
+    int upto;
+    pqSyntaxStream::fragments l = stream->take(upto);
+    {   toggle t(skip_changes);
+        hl->scan_fragments(l, upto);
+    }
+    highlight_timer.start();
 }
 
 void pqSource::runHighliter()
 {
+    if (sender() != stream)
+        return;
+
+    streamFragments();
     //qDebug() << hl->structure();
     hl->scan_done();
-    hl->rehighlight();
+    highlight_timer.start();
+
+    // edits done while scanning
+    if (!recolor_pending.isEmpty())
+        recolor_timer.start();
+}
+
+// apply semantic info where still missing, visible area first, in steps to keep GUI responsive
+//
+void pqSource::highlightPending()
+{
+    QRect v = viewport()->rect();
+    pqSyntaxData::range visible(cursorForPosition(v.topLeft()).position(), cursorForPosition(v.bottomRight()).position() + 1);
+
+    bool more;
+    {   toggle t(skip_changes);
+        more = hl->rehighlight_pending(visible, 256);
+    }
+    if (more)
+        highlight_timer.start();
+    else if (hl->sem_info_avail() && sender() == &highlight_timer)
+        highlightComplete();
 }
 
 void pqSource::highlightComplete()
@@ -437,52 +442,143 @@ void pqSource::contentsChange(int position, int charsRemoved, int charsAdded)
         */
     if (skip_changes)
         return;
+    if (hl->scanning_now()) {
+        // fragments are from file: edited areas are recoloured after scan_done
+        hl->scan_edit(position, charsRemoved, charsAdded);
+        queueRecolor(position, charsRemoved, charsAdded);
+        return;
+    }
     if (!hl->sem_info_avail())
         return;
 
     // reoffset
     hl->contentsChange(position, charsRemoved, charsAdded);
 
-    ParenMatching::range mr(position, charsRemoved, charsAdded);
-    pqSyntaxData pqsd;
-    T errorPos;
+    queueRecolor(position, charsRemoved, charsAdded);
+    recolor_timer.start();
 
-    skip_changes = true;
+    if (charsRemoved != charsAdded) // try to avoid undue signal...
 
-    try {
-        auto colorize = [&](QString frag) {
-            if (recolor(A(frag), A(file), &pqsd, errorPos)) {
-                if (errorPos.type() == PL_VARIABLE) {
-                    hl->reconcile(position, pqsd);
-                    hl->rehighlightBlock(document()->findBlock(position));
-                    // inform user about symbol change
-                    emit cursorPositionChanged();
-                }
-                else
-                    emit reportError(tr("recolor: error at %1").arg(long(errorPos)));
-            }
-        };
+    set_modified(true);
+}
 
-        QString cap = hl->get_clause_at(position);
-        if (!cap.isEmpty()) {
-            colorize(cap);
-        }
-        else if (mr.size() > 0) {
-            QString cr = mr.linesText(document());
-            if (!cr.trimmed().isEmpty()) {
-                colorize(cr);
-            }
+/**
+ * @brief pqSource::queueRecolor
+ *  queue an edited area, keeping queued areas aligned
+ */
+void pqSource::queueRecolor(int position, int charsRemoved, int charsAdded)
+{
+    int delta = charsAdded - charsRemoved;
+    for (int i = 0; i < recolor_pending.size(); ++i) {
+        ParenMatching::range &r = recolor_pending[i];
+        if (r.beg > position)
+            r.beg = qMax(position, r.beg + delta);
+        if (r.end > position)
+            r.end = qMax(position, r.end + delta);
+    }
+    recolor_pending << ParenMatching::range(position, charsRemoved, charsAdded);
+}
+
+/**
+ * @brief pqSource::recolorPending
+ *  typing paused: recolour edited clauses on a background engine
+ *  edits in same clause are coalesced, only a job at time runs
+ */
+void pqSource::recolorPending()
+{
+    if (!hl->sem_info_avail()) {
+        recolor_pending.clear();
+        return;
+    }
+    if (recolor_running)
+        return;
+
+    recolor_jobs jobs;
+    QList<int> clauses;
+    foreach(auto r, recolor_pending) {
+        recolor_job j;
+        j.position = r.beg;
+        j.done = false;
+        j.error = -1;
+
+        if (auto cb = hl->clause_extent(r.beg)) {
+            if (clauses.contains(cb.beg))
+                continue;
+            clauses << cb.beg;
+            j.text = hl->get_clause_at(r.beg);
         }
+        else if (r.size() > 0)
+            j.text = r.linesText(document());
+
+        if (!j.text.trimmed().isEmpty())
+            jobs << j;
     }
-    catch(PlException e) {
-        //qDebug() << "exception" << t2w(e);
+    if (jobs.isEmpty()) {
+        recolor_pending.clear();
+        return;
     }
 
-    skip_changes = false;
+    auto f = [](QString file, recolor_jobs jobs) {
+        SwiPrologEngine::in_thread _it;
+        for (int i = 0; i < jobs.size(); ++i) {
+            recolor_job &j = jobs[i];
+            try {
+                T errorPos;
+                if ((j.done = recolor(A(j.text), A(file), &j.result, errorPos)) && errorPos.type() != PL_VARIABLE)
+                    j.error = long(errorPos);
+            }
+            catch(PlException e) {
+                j.done = false;
+            }
+        }
+        return jobs;
+    };
 
-    if (charsRemoved != charsAdded) // try to avoid undue signal...
+    recolor_revision = document()->revision();
+    recolor_running = new QFutureWatcher<recolor_jobs>(this);
+    connect(recolor_running, SIGNAL(finished()), SLOT(recolorDone()));
+    recolor_running->setFuture(QtConcurrent::run(f, file, jobs));
+}
 
-    set_modified(true);
+/**
+ * @brief pqSource::recolorDone
+ *  apply background results, unless document has been edited meanwhile:
+ *  then queued areas are still there, and will be recoloured again
+ */
+void pqSource::recolorDone()
+{
+    recolor_jobs jobs = recolor_running->result();
+    recolor_running->deleteLater();
+    recolor_running = 0;
+
+    if (!hl->sem_info_avail()) {
+        recolor_pending.clear();
+        return;
+    }
+    if (document()->revision() != recolor_revision) {
+        if (!recolor_pending.isEmpty() && !recolor_timer.isActive())
+            recolor_timer.start();
+        return;
+    }
+    recolor_pending.clear();
+
+    bool changed = false;
+    {   toggle t(skip_changes);
+        foreach(const recolor_job &j, jobs)
+            if (j.done) {
+                if (j.error == -1) {
+                    hl->reconcile(j.position, j.result);
+                    hl->rehighlightBlock(document()->findBlock(j.position));
+                    changed = true;
+                }
+                else
+                    emit reportError(tr("recolor: error at %1").arg(j.error));
+            }
+    }
+
+    // inform user about symbol change
+    if (changed)
+        emit cursorPositionChanged();
 }
 
 /**
@@ -886,15 +982,18 @@ void pqSource::onFoldAll() {
     if (check_avail()) {
         typedef pqSyntaxData S;
         auto &h = *folded_handler;
-        for (auto &f : hl->nesting()) {
+        const S::t_nesting &n = hl->nesting();
+        for (int i = 0; i < n.size(); ++i) {
+            const S::cat &f = n[i];
             switch (f.qualification) {
             case S::structured_comment:
             case S::directive:
             case S::clause:
             case S::grammar_rule:
             {   QTextCursor c = textCursor();
-                c.setPosition(h.translatePos(c, f.beg));
-                c.setPosition(h.translatePos(c, f.end), c.KeepAnchor);
+                S::range a = hl->top(i);
+                c.setPosition(h.translatePos(c, a.beg));
+                c.setPosition(h.translatePos(c, a.end), c.KeepAnchor);
                 h.fold(c);
             }   break;
             //case S::fullstop:
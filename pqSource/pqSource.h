@@ -34,6 +34,7 @@
 #include <QTimer>
 #include <QCompleter>
 #include <QFileInfo>
+#include <QFutureWatcher>
 
 #include "pqConsole.h"
 #include "ConsoleEdit.h"
@@ -106,6 +107,29 @@ protected:
 
     QPointer<pqHighlighter> hl;
 
+    //! the background analysis feeding hl
+    QPointer<pqSyntaxStream> stream;
+    QTimer highlight_timer;
+
+    //! a clause recoloured by recolor/4, in background
+    struct recolor_job {
+        int position;
+        QString text;
+        pqSyntaxData result;
+        bool done;
+        long error;
+    };
+    typedef QList<recolor_job> recolor_jobs;
+
+    //! edited areas, recoloured when typing pauses
+    QList<ParenMatching::range> recolor_pending;
+    QTimer recolor_timer;
+    void queueRecolor(int position, int charsRemoved, int charsAdded);
+
+    //! results apply only to the document revision they were computed on
+    QPointer<QFutureWatcher<recolor_jobs>> recolor_running;
+    int recolor_revision;
+
     enum DebugStatus { no_Debug, Running, Breaked } debugStatus;
     enum DebugCommand { no_Command, Run, StepIn, StepOver, StepOut } debugCommand;
 
@@ -187,6 +211,10 @@ protected slots:
     void runHighliter();
     void startHighliter();
     void highlightComplete();
+    void streamFragments();
+    void highlightPending();
+    void recolorPending();
+    void recolorDone();
 
     void showContextMenu(const QPoint &pt);
     void editInvoke();
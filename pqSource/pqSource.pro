@@ -35,6 +35,8 @@ SOURCES += \
     pqTextAttributes.cpp \
     pqSourceDebug.cpp \
     pqSyntaxData.cpp \
+    pqSyntaxIndex.cpp \
+    pqSyntaxStream.cpp \
     symclass.cpp \
     pqSourceMainWindow.cpp \
     MdiChildWithCheck.cpp \
@@ -50,6 +52,8 @@ HEADERS += \
     pqTrace.h \
     pqTextAttributes.h \
     pqSyntaxData.h \
+    pqSyntaxIndex.h \
+    pqSyntaxStream.h \
     symclass.h \
     MdiChildWithCheck.h \
     pqWebScript.h \
@@ -345,8 +345,8 @@ void pqSource::toggleBP()
         int p = c.position();
         pqSyntaxData::itcs l = hl->position_path(p);
         if (!l.isEmpty()) {
-            const pqSyntaxData::cat &r = *l.back();
-            if (QRegExp("goal\\(\\.+\\)").exactMatch(r.desc)) {
+            pqSyntaxData::range r = hl->moved(*l.back(), hl->shift(l.front()));
+            if (QRegExp("goal\\(\\.+\\)").exactMatch(l.back()->desc)) {
                 toggle t(skip_changes);
                 int q = bkps.indexOf(r);
                 if (q >= 0) {
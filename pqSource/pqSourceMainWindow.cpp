@@ -53,6 +53,7 @@
 #include <QFont>
 #include <QFontDialog>
 #include <QColorDialog>
+#include <QStandardPaths>
 
 structure1(library)
 structure1(atom)
@@ -124,6 +125,9 @@ pqSourceMainWindow::pqSourceMainWindow(int argc, char **argv, QWidget *parent)
     macs = new KeyboardMacros(this);
     connect(macs, SIGNAL(feedback(QString)), statusBar(), SLOT(showMessage(QString)));
     macs->setupMenu(editMenu);
+
+    // XREF graphs are often displayed repeatedly, unchanged
+    lqContextGraph::set_layout_cache_dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/layouts");
 }
 
 /**
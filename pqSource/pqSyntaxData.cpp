@@ -26,14 +26,21 @@
 #include <QtAlgorithms>
 #include <QTextStream>
 
-pqSyntaxData::cat &set_desc(pqSyntaxData::cat &c, QString desc) {
-    #define Q(q) if ((c.desc = desc) == #q) c.qualification = pqSyntaxData::q;
+#include <algorithm>
+
+pqSyntaxData::categories pqSyntaxData::qualify(QString desc) {
+    #define Q(q) if (desc == #q) return q;
     Q(structured_comment) else
     Q(directive) else
     Q(fullstop) else
     Q(clause) else
     Q(grammar_rule)
     #undef Q
+    return __other__;
+}
+
+pqSyntaxData::cat &set_desc(pqSyntaxData::cat &c, QString desc) {
+    c.qualification = pqSyntaxData::qualify(c.desc = desc);
     return c;
 }
 
@@ -41,6 +48,7 @@ pqSyntaxData::cat &set_desc(pqSyntaxData::cat &c, QString desc) {
  */
 void pqSyntaxData::add_element(const char* functor, int from, int len)
 {
+    normalize();
     cat c(from, from + len);
     insert_nested(set_desc(c, functor), cats);
 }
@@ -49,6 +57,7 @@ void pqSyntaxData::add_element(const char* functor, int from, int len)
  */
 void pqSyntaxData::add_element_attr(QString desc, int from, int len, const QTextCharFormat &fmt)
 {
+    normalize();
     cat c(from, from + len);
     c.fmt = fmt;
     insert_nested(set_desc(c, desc), cats);
@@ -58,11 +67,71 @@ void pqSyntaxData::add_element_attr(QString desc, int from, int len, const QText
  */
 void pqSyntaxData::add_element_sorted(QString desc, int from, int len, const QTextCharFormat &fmt)
 {
+    normalize();
     cat c(from, from + len);
     c.fmt = fmt;
     insert_sorted(set_desc(c, desc), cats);
 }
 
+/** by position, then longer first: a container precedes its content
+ */
+void pqSyntaxData::sort_elements(fragments &l)
+{
+    std::sort(l.begin(), l.end(), [](const fragment &a, const fragment &b) {
+        return a.from < b.from || (a.from == b.from && a.len > b.len);
+    });
+}
+
+/** build the nesting of a sorted batch in a single pass, keeping open containers on a stack
+ *  fragments overlapping without nesting are dropped, as insert_sorted does
+ */
+void pqSyntaxData::add_elements(const fragments &l)
+{
+    // fragments positions are actual: edits done while scanning are applied first
+    normalize();
+
+    t_nesting flat;
+    flat.reserve(l.size());
+    QVector<int> parent(l.size(), -1), open;
+
+    for (int i = 0; i < l.size(); ++i) {
+        const fragment &f = l[i];
+        cat c(f.from, f.from + f.len);
+        c.fmt = f.fmt;
+        flat.append(set_desc(c, f.desc));
+
+        while (!open.isEmpty() && flat[open.last()].end <= c.beg)
+            open.removeLast();
+        if (!open.isEmpty() && flat[open.last()].end < c.end)
+            parent[i] = -2;
+        else {
+            if (!open.isEmpty())
+                parent[i] = open.last();
+            open.append(i);
+        }
+    }
+
+    // children always follow their container: assemble backward, so they are complete when moved
+    t_nesting top;
+    for (int i = flat.size() - 1; i >= 0; --i) {
+        if (parent[i] == -2)
+            continue;
+        cat &c = flat[i];
+        std::reverse(c.nesting.begin(), c.nesting.end());
+        if (parent[i] >= 0)
+            flat[parent[i]].nesting.append(c);
+        else
+            top.append(c);
+    }
+    std::reverse(top.begin(), top.end());
+
+    if (cats.isEmpty() || top.isEmpty() || cats.last().end <= top.first().beg)
+        cats += top;
+    else
+        for (int i = 0; i < top.size(); ++i)
+            insert_sorted(top[i], cats);
+}
+
 /** recursive insertion, search from back
  *  relies on non overlapping fragments - i.e. correctly categorized
  */
@@ -160,14 +229,17 @@ QString pqSyntaxData::structure() const
 {
     QString r;
     QTextStream s(&r);
-    foreach (auto c, cats)
+    for (int i = 0; i < cats.size(); ++i) {
+        cat c = cats[i];
+        offset(c, shift(i));
         s << c.structure("");
+    }
     return r;
 }
 
 /** recursive offseting stored data
  */
-void pqSyntaxData::apply_delta(t_nesting &c, int position, int delta)
+void pqSyntaxData::apply_delta(t_nesting &c, int position, int delta, int origin)
 {
     t_nesting::iterator p = qLowerBound(c.begin(), c.end(), cat(position, position));
     if (p != c.begin())
@@ -176,8 +248,8 @@ void pqSyntaxData::apply_delta(t_nesting &c, int position, int delta)
     while (p != c.end()) {
         if (p->beg >= position) {
             p->beg += delta;
-            if (p->beg < 0)
-                p->beg = 0;
+            if (p->beg < origin)
+                p->beg = origin;
         }
         if (p->end > position) {
             p->end += delta;
@@ -188,19 +260,104 @@ void pqSyntaxData::apply_delta(t_nesting &c, int position, int delta)
         if (p > q && p->beg < q->end)
             p = c.erase(p);
         else {
-            apply_delta(p->nesting, position, delta);
+            apply_delta(p->nesting, position, delta, origin);
             q = p;
             ++p;
         }
     }
 }
 
+int pqSyntaxData::shift(int i) const
+{
+    int s = 0;
+    if (!shifts.isEmpty())
+        for (++i; i > 0; i -= i & -i)
+            s += shifts[i];
+    return s;
+}
+
+/** move top level areas from index <from> on
+ */
+void pqSyntaxData::add_shift(int from, int delta)
+{
+    if (shifts.isEmpty())
+        shifts.fill(0, cats.size() + 1);
+    for (++from; from < shifts.size(); from += from & -from)
+        shifts[from] += delta;
+}
+
+void pqSyntaxData::offset(cat &c, int delta)
+{
+    c.beg += delta;
+    c.end += delta;
+    for (int i = 0; i < c.nesting.size(); ++i)
+        offset(c.nesting[i], delta);
+}
+
+/** O(size): only required when top level areas are inserted or removed
+ */
+void pqSyntaxData::normalize()
+{
+    if (shifts.isEmpty())
+        return;
+    for (int i = 0; i < cats.size(); ++i)
+        if (int s = shift(i))
+            offset(cats[i], s);
+    shifts.clear();
+}
+
+/** shifts keep top level order: plain bisection, on actual positions
+ */
+int pqSyntaxData::top_lower_bound(int position) const
+{
+    int l = 0, h = cats.size();
+    while (l < h) {
+        int m = (l + h) / 2;
+        if (cats[m].beg + shift(m) < position)
+            l = m + 1;
+        else
+            h = m;
+    }
+    return l;
+}
+
+int pqSyntaxData::top_at(int position) const
+{
+    int i = top_lower_bound(position + 1) - 1;
+    return i >= 0 && top(i).contains(position) ? i : -1;
+}
+
 /** shift stored positions as required by changes
  *  keep the structure aligned while editing
+ *  areas after the change move as a whole, by a Fenwick tree update, and only the one
+ *  containing the change is visited: typing doesn't depend on file size
  */
 void pqSyntaxData::contentsChange(int position, int charsRemoved, int charsAdded)
 {
-    apply_delta(cats, position, charsAdded - charsRemoved);
+    int delta = charsAdded - charsRemoved;
+    if (delta == 0 || cats.isEmpty())
+        return;
+
+    int first = top_lower_bound(position);
+    if (top_lower_bound(position + charsRemoved) > first) {
+        // removed text holds top level areas: rare, rebuild the top level
+        normalize();
+        apply_delta(cats, position, delta);
+    }
+    else {
+        // the container, if any, is resized in its own frame
+        if (first > 0) {
+            int s = shift(first - 1);
+            cat &c = cats[first - 1];
+            if (c.end + s > position) {
+                c.end += delta;
+                if (c.end < c.beg)
+                    c.end = position - s;
+                apply_delta(c.nesting, position - s, delta, -s);
+            }
+        }
+        add_shift(first, delta);
+    }
     Q_ASSERT(check());
 }
 
@@ -212,13 +369,8 @@ void pqSyntaxData::reconcile(int position, const pqSyntaxData &updated)
     Q_ASSERT(check());
     Q_ASSERT(updated.check());
 
-    //! recursive lambda: nice !
-    std::function<void(cat &, int)> add_offset = [&](cat &c, int delta) {
-        c.beg += delta;
-        c.end += delta;
-        for (int i = 0; i < c.nesting.size(); ++i)
-            add_offset(c.nesting[i], delta);
-    };
+    // top level is changed: stored positions must be actual
+    normalize();
 
     if (updated.cats.size() >= 2 && updated.cats[0].desc == "range") {
 
@@ -235,10 +387,10 @@ void pqSyntaxData::reconcile(int position, const pqSyntaxData &updated)
 
             for (int i = 0; i < uns; ++i) {
                 cats.insert(cb.beg + i, uc.nesting[i]);
-                add_offset(cats[cb.beg + i], delta);
+                offset(cats[cb.beg + i], delta);
             }
             cats.insert(cb.beg + uns, updated.cats[1]);
-            add_offset(cats[cb.beg + uns], delta);
+            offset(cats[cb.beg + uns], delta);
 
             cats.remove(cb.beg + uc.nesting.size(), cb.size() + 1);
         }
@@ -248,10 +400,10 @@ void pqSyntaxData::reconcile(int position, const pqSyntaxData &updated)
 
             for (int i = 0; i < uns; ++i) {
                 cats.insert(q + i, uc.nesting[i]);
-                add_offset(cats[q + i], position);
+                offset(cats[q + i], position);
             }
             cats.insert(q + uns, updated.cats[1]);
-            add_offset(cats[q + uns], position);
+            offset(cats[q + uns], position);
         }
     }
     else if (updated.cats[0].desc == "comment") {
@@ -269,14 +421,12 @@ void pqSyntaxData::reconcile(int position, const pqSyntaxData &updated)
  */
 pqSyntaxData::range pqSyntaxData::clause_boundary(int position) const
 {
-    t_nesting::const_iterator p = qLowerBound(cats.begin(), cats.end(), cat(position, position));
-    if (!p->contains(position) && p != cats.begin())
-        --p;
-    if (p != cats.end() && p->contains(position)) {
-        t_nesting::const_iterator dot = p + 1;
-        if (dot != cats.end() && dot->size() == 1 && dot->desc == "fullstop")
+    int p = top_at(position);
+    if (p >= 0) {
+        int dot = p + 1;
+        if (dot < cats.size() && cats[dot].size() == 1 && cats[dot].desc == "fullstop")
             // get offsets
-            return range(p - cats.begin(), dot - cats.begin());
+            return range(p, dot);
     }
     return range();
 }
@@ -301,7 +451,14 @@ pqSyntaxData::itc pqSyntaxData::find_position(int position, const t_nesting &n)
 pqSyntaxData::itcs pqSyntaxData::position_path(int position) const
 {
     itcs l;
-    const t_nesting *n = &cats;
+    int t = top_at(position);
+    if (t < 0)
+        return l;
+
+    // nested areas are stored in the frame of their top level one
+    l << cats.begin() + t;
+    position -= shift(t);
+    const t_nesting *n = &cats[t].nesting;
     for ( ; ; ) {
         itc p = find_position(position, *n);
         if (p != n->end()) {
@@ -368,7 +525,7 @@ pqSyntaxData::range pqSyntaxData::clause_extent(int position) const {
     range cb = clause_boundary(position);
     if (cb.size() > 0 && cb.end < cats.size()) {
         // get actual positions
-        int start = cats[cb.beg].beg, stop = cats[cb.end].end;
+        int start = top(cb.beg).beg, stop = top(cb.end).end;
         return range(start, stop);
     }
     return range();
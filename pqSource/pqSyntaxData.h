@@ -37,6 +37,8 @@
 /** this class collects structured data from SWI-Prolog syntax helper
   * as the library releases info in a non-strict lexical order, by means of a callback,
   * the code recovers the nesting and keep a sorted tree
+  * edits move top level subtrees lazily: positions stored in cats[i] subtree
+  * are off by shift(i), use top(), moved() or a position less shift(i) to compare
   */
 class PQSOURCESHARED_EXPORT pqSyntaxData {
 
@@ -59,6 +61,9 @@ public:
         __other__
     };
 
+    //! map description to category
+    static categories qualify(QString desc);
+
     /** this recursive data structure it's the heart of syntax report
       * note: no pointers (except inside QVector...)
       */
@@ -89,6 +94,20 @@ public:
     typedef t_nesting::const_iterator itc;
     typedef QList<itc> itcs;
 
+    //! a categorized text area, as reported by library(prolog_colour), not yet nested
+    struct fragment {
+        QString desc;
+        int from, len;
+        QTextCharFormat fmt;
+    };
+    typedef QVector<fragment> fragments;
+
+    //! order required by add_elements: by position, outer first
+    static void sort_elements(fragments &l);
+
+    //! nest a sorted batch at once, faster than add_element_sorted on each
+    void add_elements(const fragments &l);
+
     //! from library callback (so called closure)
     void add_element(const char* functor, int from, int len);
 
@@ -126,8 +145,25 @@ public:
     range clause_extent(int position) const;
 
     //! need readonly access to build on structure...
+    //! positions in the subtree of top level nesting()[i] are to be moved by shift(i)
     const t_nesting& nesting() const { return cats; }
 
+    //! pending edit offset of top level area <i> and its subtree
+    int shift(int i) const;
+    int shift(itc top) const { return shift(int(top - cats.begin())); }
+
+    //! actual positions of top level area <i>
+    range top(int i) const { int s = shift(i); return range(cats[i].beg + s, cats[i].end + s); }
+
+    //! actual positions of <r>, stored in a subtree with shift <s>
+    static range moved(const range &r, int s) { return range(r.beg + s, r.end + s); }
+
+    //! top level area containing position, -1 if none
+    int top_at(int position) const;
+
+    //! first top level area beginning at or after position
+    int top_lower_bound(int position) const;
+
     //! folding changes the text buffer... let it know
     void fold(range r);
 
@@ -142,11 +178,19 @@ protected:
     //! attempt to adjust structure to recover proper nesting
     void insert_sorted(cat &inner, t_nesting& nest);
 
-    //! remember previous variable highlighting
-    QList<const cat*> hvars;
+    //! remember previous variable highlighting, actual positions
+    QList<range> hvars;
+
+    //! recursive offseting stored data, in a frame where text begins at <origin>
+    void apply_delta(t_nesting &cats, int position, int delta, int origin = 0);
+
+    //! Fenwick tree (1 based) of edit offsets by top level index, empty when none pending
+    QVector<int> shifts;
+    void add_shift(int from, int delta);
 
-    //! recursive offseting stored data
-    void apply_delta(t_nesting &cats, int position, int delta);
+    //! move pending offsets into stored positions, before changing the top level
+    void normalize();
+    static void offset(cat &c, int delta);
 };
 
 #endif // PQSYNTAXDATA_H
@@ -0,0 +1,454 @@
+/*
+    pqSource     : interfacing SWI-Prolog source files and Qt
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "pqSyntaxIndex.h"
+#include "PREDICATE.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <limits>
+
+// typing(Where, TreeMicroseconds, IndexMicroseconds)
+structure3(typing)
+
+void pqSyntaxIndex::clear()
+{
+    nodes.clear();
+    shifts.clear();
+    descs.clear();
+    quals.clear();
+    desc_ids.clear();
+    palette.clear();
+    palette_by_desc.clear();
+}
+
+pqSyntaxIndex::id pqSyntaxIndex::intern(QString desc)
+{
+    auto p = desc_ids.constFind(desc);
+    if (p != desc_ids.constEnd())
+        return *p;
+
+    Q_ASSERT(descs.size() <= std::numeric_limits<id>::max());
+    id i = id(descs.size());
+    descs.append(desc);
+    quals.append(pqSyntaxData::qualify(desc));
+    desc_ids.insert(desc, i);
+    return i;
+}
+
+/** QTextCharFormat isn't hashable, but few formats are used by each category
+ */
+pqSyntaxIndex::id pqSyntaxIndex::intern(id desc, const QTextCharFormat &fmt)
+{
+    QVector<id> &l = palette_by_desc[desc];
+    foreach(id f, l)
+        if (palette[f] == fmt)
+            return f;
+
+    Q_ASSERT(palette.size() <= std::numeric_limits<id>::max());
+    id f = id(palette.size());
+    palette.append(fmt);
+    l.append(f);
+    return f;
+}
+
+int pqSyntaxIndex::append(const pqSyntaxData::cat &c, int parent)
+{
+    int i = nodes.size();
+
+    node n(c.beg, c.end);
+    n.parent = parent;
+    n.desc = intern(c.desc);
+    n.fmt = intern(n.desc, c.fmt);
+    nodes.append(n);
+
+    foreach(const pqSyntaxData::cat &x, c.nesting)
+        append(x, i);
+
+    nodes[i].next = nodes.size();
+    return i;
+}
+
+/** preorder visit of tree gives the flat order
+ */
+void pqSyntaxIndex::build(const pqSyntaxData::t_nesting &nest)
+{
+    clear();
+    foreach(const pqSyntaxData::cat &c, nest)
+        append(c, -1);
+    nodes.squeeze();
+    shifts.fill(0, nodes.size() + 1);
+}
+
+/** same single pass as pqSyntaxData::add_elements, but no tree to assemble:
+ *  dropped fragments (overlapping without nesting) are simply not stored
+ */
+void pqSyntaxIndex::build(const pqSyntaxData::fragments &sorted)
+{
+    clear();
+    nodes.reserve(sorted.size());
+
+    QVector<int> open;
+    auto close = [&]() {
+        nodes[open.last()].next = nodes.size();
+        open.removeLast();
+    };
+
+    foreach(const pqSyntaxData::fragment &f, sorted) {
+        node n(f.from, f.from + f.len);
+
+        while (!open.isEmpty() && nodes[open.last()].end <= n.beg)
+            close();
+        if (!open.isEmpty() && nodes[open.last()].end < n.end)
+            continue;
+
+        n.parent = open.isEmpty() ? -1 : open.last();
+        n.desc = intern(f.desc);
+        n.fmt = intern(n.desc, f.fmt);
+        open.append(nodes.size());
+        nodes.append(n);
+    }
+    while (!open.isEmpty())
+        close();
+
+    nodes.squeeze();
+    shifts.fill(0, nodes.size() + 1);
+}
+
+int pqSyntaxIndex::next_sibling(int i) const
+{
+    int s = nodes[i].next;
+    if (s < nodes.size() && nodes[s].parent == nodes[i].parent)
+        return s;
+    return -1;
+}
+
+int pqSyntaxIndex::shift(int i) const
+{
+    int s = 0;
+    for (++i; i > 0; i -= i & -i)
+        s += shifts[i];
+    return s;
+}
+
+/** shift all nodes from index <from> on
+ */
+void pqSyntaxIndex::add_shift(int from, int delta)
+{
+    for (++from; from < shifts.size(); from += from & -from)
+        shifts[from] += delta;
+}
+
+/** shifts keep begin order: plain bisection, on actual positions
+ */
+int pqSyntaxIndex::lower_bound(int position) const
+{
+    int l = 0, h = nodes.size();
+    while (l < h) {
+        int m = (l + h) / 2;
+        if (nodes[m].beg + shift(m) < position)
+            l = m + 1;
+        else
+            h = m;
+    }
+    return l;
+}
+
+/** nodes are sorted by begin: the last one starting at or before position,
+ *  if not containing it, is nested in the innermost one that does
+ */
+int pqSyntaxIndex::innermost(int position) const
+{
+    int i = lower_bound(position + 1) - 1;
+    while (i >= 0 && !at(i).contains(position))
+        i = nodes[i].parent;
+    return i;
+}
+
+pqSyntaxIndex::path pqSyntaxIndex::position_path(int position) const
+{
+    path l;
+    for (int i = innermost(position); i >= 0; i = nodes[i].parent)
+        l.prepend(i);
+    return l;
+}
+
+int pqSyntaxIndex::find_position(int position, int parent) const
+{
+    for (int i = innermost(position); i >= 0; i = nodes[i].parent)
+        if (nodes[i].parent == parent)
+            return i;
+    return -1;
+}
+
+pqSyntaxIndex::range pqSyntaxIndex::clause_boundary(int position) const
+{
+    int c = find_position(position);
+    if (c >= 0) {
+        int dot = nodes[c].next;
+        if (dot < nodes.size() && nodes[dot].size() == 1 && desc(dot) == "fullstop")
+            return range(c, dot);
+    }
+    return range();
+}
+
+pqSyntaxIndex::range pqSyntaxIndex::clause_extent(int position) const
+{
+    range cb = clause_boundary(position);
+    if (cb.size() > 0)
+        return range(at(cb.beg).beg, at(cb.end).end);
+    return range();
+}
+
+void pqSyntaxIndex::topdown_preorder(int i, std::function<void(int)> f) const
+{
+    for (int n = nodes[i].next; i < n; ++i)
+        f(i);
+}
+
+/** same rules as pqSyntaxData::apply_delta: areas starting after the change move,
+ *  those containing it are resized. Only nodes in removed text, and containers,
+ *  are touched one by one, the others get the shift in O(log n)
+ */
+void pqSyntaxIndex::contentsChange(int position, int charsRemoved, int charsAdded)
+{
+    int delta = charsAdded - charsRemoved, removed_end = position + charsRemoved;
+    if (delta == 0 || nodes.isEmpty())
+        return;
+
+    auto moved = [&](int p) { return p >= removed_end ? p + delta : position; };
+
+    int first = lower_bound(position), after = lower_bound(removed_end);
+
+    // containers, outermost included: in the ancestors chain of node before change
+    int i = first - 1;
+    while (i >= 0 && at(i).end <= position)
+        i = nodes[i].parent;
+    for ( ; i >= 0; i = nodes[i].parent)
+        nodes[i].end = moved(at(i).end) - shift(i);
+
+    // inside removed text
+    QVector<range> removed;
+    for (int j = first; j < after; ++j)
+        removed.append(range(position, moved(at(j).end)));
+
+    add_shift(after, delta);
+
+    for (int j = first; j < after; ++j) {
+        int s = shift(j);
+        nodes[j].beg = removed[j - first].beg - s;
+        nodes[j].end = removed[j - first].end - s;
+    }
+}
+
+size_t pqSyntaxIndex::memory_usage() const
+{
+    size_t m = nodes.capacity() * sizeof(node) + shifts.capacity() * sizeof(int) + palette.capacity() * sizeof(QTextCharFormat);
+    foreach(QString d, descs)
+        m += sizeof(QString) + size_t(d.capacity()) * sizeof(QChar);
+    foreach(QTextCharFormat f, palette)
+        m += size_t(f.properties().size()) * (sizeof(int) + sizeof(QVariant));
+    return m;
+}
+
+/** an estimate: each cat owns its string and format data, not shared after callback
+ */
+size_t pqSyntaxIndex::memory_usage(const pqSyntaxData::t_nesting &nest)
+{
+    size_t m = size_t(nest.capacity()) * sizeof(pqSyntaxData::cat);
+    foreach(const pqSyntaxData::cat &c, nest) {
+        m += sizeof(QString) + size_t(c.desc.capacity()) * sizeof(QChar);
+        m += size_t(c.fmt.properties().size()) * (sizeof(int) + sizeof(QVariant));
+        m += memory_usage(c.nesting);
+    }
+    return m;
+}
+
+/** a synthetic source of <clauses> clauses, each like 'p(X,Y) :- q(X), r(Y).',
+ *  fragments sorted as the stream delivers them
+ */
+static const int synthetic_stride = 25;
+static pqSyntaxData::fragments synthetic_source(int clauses)
+{
+    const int stride = synthetic_stride;
+    pqSyntaxData::fragments l;
+    l.reserve(clauses * 12);
+    auto frag = [&](QString desc, int from, int to) { l.append(pqSyntaxData::fragment { desc, from, to - from, QTextCharFormat() }); };
+    for (int k = 0; k < clauses; ++k) {
+        int b = k * stride;
+        frag("fullstop", b + 23, b + 24);
+        frag("var", b + 2, b + 3);
+        frag("var", b + 4, b + 5);
+        frag("clause", b, b + 23);
+        frag("head", b, b + 6);
+        frag("neck", b + 7, b + 9);
+        frag("goal", b + 10, b + 14);
+        frag("var", b + 12, b + 13);
+        frag("goal", b + 16, b + 20);
+        frag("var", b + 18, b + 19);
+    }
+    pqSyntaxData::sort_elements(l);
+    return l;
+}
+
+/** syntax_edit_benchmark(+Clauses, -Timings)
+ *  micro benchmark of edit offset maintenance, on a synthetic source of <Clauses> clauses,
+ *  each like 'p(X,Y) :- q(X), r(Y).'. Timings is a list of typing(Where, Tree, Index),
+ *  with average microseconds per keystroke, typing at start, middle and end
+ *  note: pqSyntaxData::contentsChange checks the whole tree in debug builds
+ */
+PREDICATE(syntax_edit_benchmark, 2)
+{
+    int clauses = PL_A1;
+    const int stride = synthetic_stride, keys = 100;
+
+    pqSyntaxData::fragments l = synthetic_source(clauses);
+
+    pqSyntaxData tree;
+    tree.add_elements(l);
+    pqSyntaxIndex index;
+    index.build(l);
+    qDebug() << "syntax_edit_benchmark" << clauses << "clauses, bytes: tree" << pqSyntaxIndex::memory_usage(tree.nesting()) << "index" << index.memory_usage();
+
+    QElapsedTimer tm;
+    PlTail timings(PL_A2);
+    int where[] = { 0, clauses / 2 * stride, clauses * stride - 1 };
+    const char *names[] = { "start", "middle", "end" };
+    for (int w = 0; w < 3; ++w) {
+        int p = where[w] + 1;
+
+        tm.start();
+        for (int k = 0; k < keys; ++k)
+            tree.contentsChange(p + k, 0, 1);
+        long t_tree = long(tm.nsecsElapsed() / 1000 / keys);
+
+        tm.start();
+        for (int k = 0; k < keys; ++k)
+            index.contentsChange(p + k, 0, 1);
+        long t_index = long(tm.nsecsElapsed() / 1000 / keys);
+
+        timings.append(typing(A(names[w]), t_tree, t_index));
+    }
+    return timings.close();
+}
+
+/** syntax_index_check(+Clauses, -Mismatches)
+ *  build both stores from the same sorted batch of synthetic_source(Clauses),
+ *  then compare their answers at every position: position_path, find_position,
+ *  clause_boundary, clause_extent and topdown_preorder of the outermost area.
+ *  The comparison is repeated after typing and deleting at start, middle and end,
+ *  to cover pending shifts of both stores.
+ *  Mismatches is the number of positions with different answers, each one is logged
+ */
+PREDICATE(syntax_index_check, 2)
+{
+    int clauses = PL_A1;
+    pqSyntaxData::fragments l = synthetic_source(clauses);
+
+    pqSyntaxData tree;
+    tree.add_elements(l);
+    pqSyntaxIndex index;
+    index.build(l);
+
+    typedef pqSyntaxData::range range;
+    typedef QPair<range, QString> area;
+    const pqSyntaxData::t_nesting &top = tree.nesting();
+
+    auto tree_area = [](const pqSyntaxData::cat &c, int s) { return area(pqSyntaxData::moved(c, s), c.desc); };
+    auto index_area = [&](int i) { return area(index.at(i), index.desc(i)); };
+
+    long mismatches = 0;
+    int length = clauses * synthetic_stride;
+
+    auto compare = [&](QString when) {
+        for (int p = 0; p <= length; ++p) {
+            QStringList diff;
+
+            pqSyntaxData::itcs tp = tree.position_path(p);
+            pqSyntaxIndex::path ip = index.position_path(p);
+            int s = tp.isEmpty() ? 0 : tree.shift(tp[0]);
+            QVector<area> ta, ia;
+            foreach(auto c, tp)
+                ta << tree_area(*c, s);
+            foreach(int i, ip)
+                ia << index_area(i);
+            if (ta != ia)
+                diff << "position_path";
+
+            // top level by bisection, then inside the outermost area
+            int tt = tree.top_at(p), xf = index.find_position(p);
+            if ((tt < 0) != (xf < 0) || (xf >= 0 && area(tree.top(tt), top[tt].desc) != index_area(xf)))
+                diff << "find_position";
+            else if (xf >= 0) {
+                pqSyntaxData::itc tf = pqSyntaxData::find_position(p - s, top[tt].nesting);
+                int xn = index.find_position(p, xf);
+                if ((tf == top[tt].nesting.end()) != (xn < 0) || (xn >= 0 && tree_area(*tf, s) != index_area(xn)))
+                    diff << "find_position";
+            }
+
+            range tb = tree.clause_boundary(p), xb = index.clause_boundary(p);
+            if (tb.size() != xb.size() ||
+                (tb.size() > 0 && (area(tree.top(tb.beg), top[tb.beg].desc) != index_area(xb.beg) ||
+                                   area(tree.top(tb.end), top[tb.end].desc) != index_area(xb.end))))
+                diff << "clause_boundary";
+
+            if (!(tree.clause_extent(p) == index.clause_extent(p)))
+                diff << "clause_extent";
+
+            ta.clear();
+            ia.clear();
+            if (!tp.isEmpty())
+                tree.topdown_preorder(*tp[0], [&](const pqSyntaxData::cat &c) { ta << tree_area(c, s); });
+            if (!ip.isEmpty())
+                index.topdown_preorder(ip[0], [&](int i) { ia << index_area(i); });
+            if (ta != ia)
+                diff << "topdown_preorder";
+
+            if (!diff.isEmpty()) {
+                qDebug() << "syntax_index_check" << when << p << diff;
+                ++mismatches;
+            }
+        }
+    };
+
+    auto edit = [&](int position, int removed, int added) {
+        tree.contentsChange(position, removed, added);
+        index.contentsChange(position, removed, added);
+        length += added - removed;
+    };
+
+    compare("built");
+
+    // backward, so clauses to edit are still at their place
+    // deletions must not start an area: the stores differ on removed area beginnings
+    int where[] = { 0, clauses / 2 * synthetic_stride, (clauses - 1) * synthetic_stride };
+    for (int w = 2; w >= 0; --w) {
+        int b = where[w];
+        edit(b + 25, 0, 2);     // typing before next clause
+        edit(b + 11, 0, 3);     // typing inside a goal
+        edit(b + 12, 1, 0);     // deleting typed text
+    }
+    compare("edited");
+
+    return PL_A2 = mismatches;
+}
@@ -0,0 +1,142 @@
+/*
+    pqSource     : interfacing SWI-Prolog source files and Qt
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef PQSYNTAXINDEX_H
+#define PQSYNTAXINDEX_H
+
+#include "pqSyntaxData.h"
+
+#include <QHash>
+#include <QStringList>
+
+/** compact alternative to pqSyntaxData nesting
+  * nodes are stored flat, in preorder (i.e. sorted by position, container first),
+  * with parent and subtree end indices. Categories are interned, formats shared in a palette,
+  * so a node is a few ints instead of a QString, a QTextCharFormat and a QVector
+  * Edits don't touch stored positions after the change point: a Fenwick tree
+  * over node indices holds the accumulated shifts, so contentsChange is O(log n)
+  */
+class PQSOURCESHARED_EXPORT pqSyntaxIndex {
+
+public:
+
+    typedef pqSyntaxData::range range;
+    typedef quint16 id;
+
+    //! a categorized text area - positions are stored before shifting, use at()
+    struct node : range {
+        node(int beg = -1, int end = -1) : range(beg, end) {}
+
+        //! -1 at top level
+        int parent;
+
+        //! past last descendant: the subtree is [index, next)
+        int next;
+
+        //! index in category names and format palette
+        id desc, fmt;
+    };
+    typedef QVector<node> t_nodes;
+
+    //! nodes on the nesting path of a position, outermost first
+    typedef QVector<int> path;
+
+    pqSyntaxIndex() {}
+    explicit pqSyntaxIndex(const pqSyntaxData::t_nesting &nest) { build(nest); }
+
+    //! convert from tree representation, stored positions: use on a tree not yet edited
+    void build(const pqSyntaxData::t_nesting &nest);
+
+    //! from a batch sorted by pqSyntaxData::sort_elements
+    void build(const pqSyntaxData::fragments &sorted);
+
+    void clear();
+
+    int size() const { return nodes.size(); }
+
+    //! actual text positions of node <i>
+    range at(int i) const { int s = shift(i); return range(nodes[i].beg + s, nodes[i].end + s); }
+
+    //! node attributes, from interned data
+    const QString& desc(int i) const { return descs[nodes[i].desc]; }
+    const QTextCharFormat& fmt(int i) const { return palette[nodes[i].fmt]; }
+    pqSyntaxData::categories qualification(int i) const { return quals[nodes[i].desc]; }
+
+    //! navigation, -1 when missing
+    int parent(int i) const { return nodes[i].parent; }
+    int first_child(int i) const { return i + 1 < nodes[i].next ? i + 1 : -1; }
+    int next_sibling(int i) const;
+
+    //! innermost node containing position, -1 if none
+    int innermost(int position) const;
+
+    //! find the nested path of position
+    path position_path(int position) const;
+
+    //! node containing position among children of <parent> (-1 for top level)
+    int find_position(int position, int parent = -1) const;
+
+    //! a clause can span more than a category area: get clause and fullstop nodes
+    range clause_boundary(int position) const;
+
+    //! get text begin/end positions
+    range clause_extent(int position) const;
+
+    //! visit subtree of <i>, in preorder
+    void topdown_preorder(int i, std::function<void(int)> f) const;
+
+    //! keep positions aligned while editing
+    void contentsChange(int position, int charsRemoved, int charsAdded);
+
+    //! heap bytes, for comparison with tree representation
+    size_t memory_usage() const;
+    static size_t memory_usage(const pqSyntaxData::t_nesting &nest);
+
+private:
+
+    t_nodes nodes;
+
+    //! Fenwick tree (1 based): shift of node i is the prefix sum up to i + 1
+    QVector<int> shifts;
+    int shift(int i) const;
+    void add_shift(int from, int delta);
+
+    //! first node beginning at or after position
+    int lower_bound(int position) const;
+
+    //! interned categories
+    QStringList descs;
+    QVector<pqSyntaxData::categories> quals;
+    QHash<QString, id> desc_ids;
+
+    //! shared formats, indexed by category to keep lookup short
+    QVector<QTextCharFormat> palette;
+    QHash<id, QVector<id>> palette_by_desc;
+
+    id intern(QString desc);
+    id intern(id desc, const QTextCharFormat &fmt);
+
+    //! append subtree of <c>, return index
+    int append(const pqSyntaxData::cat &c, int parent);
+};
+
+#endif // PQSYNTAXINDEX_H
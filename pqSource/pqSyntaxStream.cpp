@@ -0,0 +1,130 @@
+/*
+    pqSource     : interfacing SWI-Prolog source files and Qt
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "pqSyntaxStream.h"
+#include "pqTextAttributes.h"
+#include "SwiPrologEngine.h"
+#include "PREDICATE.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <climits>
+#include <algorithm>
+
+// from :/prolog/syncol.pl
+predicate2(syncol_stream)
+
+pqSyntaxStream::pqSyntaxStream(QString file, QObject *parent) :
+    QThread(parent),
+    file(file),
+    max_end(0),
+    ready_upto(0)
+{
+    current.reserve(batch_size);
+}
+
+void pqSyntaxStream::cancel()
+{
+    cancelled.storeRelease(1);
+    QMutexLocker lk(&lock);
+    consumed.wakeAll();
+}
+
+/** the engine lives only while colourising
+ */
+void pqSyntaxStream::run()
+{
+    QElapsedTimer tm;
+    tm.start();
+
+    SwiPrologEngine::in_thread _it;
+    try {
+        int rc = syncol_stream(A(file), this);
+        qDebug() << file << "syncol_stream" << rc << "in" << tm.elapsed();
+    }
+    catch(PlException e) {
+        qDebug() << file << "syncol_stream" << t2w(e);
+    }
+
+    QMutexLocker lk(&lock);
+    max_end = INT_MAX;
+    flush(true);
+}
+
+/** a fragment starting beyond all pending ones begins a new term:
+ *  library(prolog_colour) reports terms in order, their fragments in any order
+ */
+bool pqSyntaxStream::add(QString desc, int from, int len, const QTextCharFormat &fmt)
+{
+    if (is_cancelled())
+        return false;
+
+    QMutexLocker lk(&lock);
+    if (from >= max_end && current.size() >= batch_size)
+        flush(true);
+
+    while (ready.size() >= max_pending && !is_cancelled())
+        consumed.wait(&lock);
+
+    current.append(fragment { desc, from, len, fmt });
+    max_end = qMax(max_end, from + len);
+    return true;
+}
+
+/** sorted here, on worker, as required by pqSyntaxData::add_elements
+ */
+void pqSyntaxStream::flush(bool notify)
+{
+    pqSyntaxData::sort_elements(current);
+    if (ready.isEmpty())
+        ready.swap(current);
+    else
+        ready += current;
+    current = fragments();
+    current.reserve(batch_size);
+    ready_upto = max_end;
+    if (notify)
+        emit fragments_ready();
+}
+
+pqSyntaxStream::fragments pqSyntaxStream::take(int &upto)
+{
+    QMutexLocker lk(&lock);
+    fragments r;
+    r.swap(ready);
+    upto = ready_upto;
+    consumed.wakeAll();
+    return r;
+}
+
+/** stream_fragment(+Stream, +Class, +From, +Len)
+ *  like callback/4, but first argument is pqSyntaxStream
+ *  fails when the stream has been cancelled
+ */
+PREDICATE(stream_fragment, 4)
+{
+    QString kind;
+    QTextCharFormat fmt;
+    pqTextAttributes::classify(PL_A2, kind, fmt);
+    return pq_cast<pqSyntaxStream>(PL_A1)->add(kind, PL_A3, PL_A4, fmt);
+}
@@ -0,0 +1,89 @@
+/*
+    pqSource     : interfacing SWI-Prolog source files and Qt
+
+    Author       : Carlo Capelli
+    E-mail       : cc.carlo.cap@gmail.com
+    Copyright (C): 2013,2014,2015,2016
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef PQSYNTAXSTREAM_H
+#define PQSYNTAXSTREAM_H
+
+#include "pqSource_global.h"
+#include "pqSyntaxData.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QTextCharFormat>
+#include <QVector>
+#include <QAtomicInt>
+
+/** run prolog_colourise_stream on a dedicated Prolog engine thread
+  * fragments are handed to GUI in position ordered batches, cut between terms,
+  * and the worker waits when too many are pending (bounded memory)
+  */
+class PQSOURCESHARED_EXPORT pqSyntaxStream : public QThread
+{
+    Q_OBJECT
+
+public:
+
+    typedef pqSyntaxData::fragment fragment;
+    typedef pqSyntaxData::fragments fragments;
+
+    //! fragments per batch, and pending before the worker waits
+    enum { batch_size = 4096, max_pending = 16 * batch_size };
+
+    pqSyntaxStream(QString file, QObject *parent = 0);
+
+    //! stop as soon as possible: results are dropped
+    void cancel();
+    bool is_cancelled() const { return cancelled.loadAcquire() != 0; }
+
+    //! GUI side: get completed batches, <upto> is the position where analysis stands
+    fragments take(int &upto);
+
+    //! called by stream_fragment/4 foreign predicate, from worker
+    bool add(QString desc, int from, int len, const QTextCharFormat &fmt);
+
+signals:
+
+    //! a batch is ready to be taken
+    void fragments_ready();
+
+protected:
+
+    void run();
+
+private:
+
+    QString file;
+    QAtomicInt cancelled;
+
+    QMutex lock;
+    QWaitCondition consumed;
+
+    //! current term fragments, and batches completed
+    fragments current, ready;
+    int max_end, ready_upto;
+
+    //! sort current terms and move to ready, notify
+    void flush(bool notify);
+};
+
+#endif // PQSYNTAXSTREAM_H
@@ -25,10 +25,41 @@
 #include <QColor>
 #include <QDebug>
 #include <QMap>
+#include <QMutex>
 #include <QTextFormat>
 
 #define unary(X) PlTerm X; PlCompound X ## _t(#X, X);
 
+// from :/prolog/syntax_colours.pl
+predicate2(syntax_colour)
+
+// shared by callback/4 and stream_fragment/4, called from any engine
+//
+bool pqTextAttributes::classify(const PlTerm &cls, QString &kind, QTextCharFormat &fmt)
+{
+    T Attributes;
+    if (!syntax_colour(cls, Attributes)) {
+        kind = cls.name();
+        return false;
+    }
+
+    switch (cls.arity()) {
+    case 0:
+    case 1:
+        kind = t2w(cls);
+        break;
+    case 2:
+    default:
+        kind = QString("%1(%2)").arg(cls.name(), cls[1].name());
+    }
+
+    static pqTextAttributes ta;
+    static QMutex mtx;
+    QMutexLocker lk(&mtx);
+    fmt = ta[Attributes];
+    return true;
+}
+
 // keep hashed attributes by list
 //
 QTextCharFormat pqTextAttributes::operator [](const PlTerm &attr_list)
@@ -43,6 +43,10 @@ public:
     /** apply naive color translation */
     QColor plColor2Qt(const PlTerm &colorname);
 
+    /** kind and format of a library(prolog_colour) class, through a shared cache
+      * false when syntax_colour/2 has no attributes for it: kind is just its name */
+    static bool classify(const PlTerm &cls, QString &kind, QTextCharFormat &fmt);
+
 protected:
 
     /** map the actual term list (really, its string representation) to attributes */
@@ -22,7 +22,7 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
-:- module(syncol, [syncol/2, recolor/4, syncolours/0, syncol_allfile/2]).
+:- module(syncol, [syncol/2, recolor/4, syncolours/0, syncol_stream/2]).
 
 :- use_module(library(prolog_xref)).
 :- use_module(library(prolog_colour)).
@@ -64,21 +64,22 @@ read_clause_positions(Atom, Module, Offset, Term, Positions, Error) :-
 syncolours :-
     forall(syntax_colour(C,A), pqSource:class_attributes(C,A)).
 
-%% process entire file in Prolog, get back results list
+%% syncol_stream(+File, +Stream)
 %
-:- thread_local frag/4.
-
-syncol_allfile(F, L) :-
-    retractall(frag(_,_,_,_)),
+%  fragments are sent to Stream (a pqSyntaxStream) while colourising,
+%  see PREDICATE(stream_fragment, 4) in pqSyntaxStream.cpp
+%  stream_fragment/4 fails when the GUI no longer needs results
+%
+syncol_stream(F, C) :-
     load_source(F),
     xref_source(F),
-    open(F, read, S),
-    prolog_colourise_stream(S, F, callback_allfile),
-    close(S),
-    setof(frag(A, B, C, D), frag(A, B, C, D), L).
+    setup_call_cleanup(
+        open(F, read, S),
+        catch(prolog_colourise_stream(S, F, callback_stream(C)), syncol_cancelled, true),
+        close(S)).
 
-callback_allfile(U, V, Z) :-
-    syntax_colour(U, Attributes) -> assertz(frag(V, Z, U, Attributes)) ; assertz(frag(V, Z, U, [])).
+callback_stream(C, U, V, Z) :-
+    stream_fragment(C, U, V, Z) -> true ; throw(syncol_cancelled).
 
 %%  apply useful behaviour changes
 %